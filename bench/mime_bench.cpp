@@ -0,0 +1,80 @@
+// Mikrobenchmark: Hashtabellen-Lookup in mime.hpp gegen den früheren linearen Scan.
+// Bauen mit -DLIVEGATE_BUILD_BENCHMARKS=ON, Aufruf: mime_bench [ITERATIONEN]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "mime.hpp"
+
+// Der frühere Lookup, nur zum Vergleich
+static const char *GetContentTypeForExtensionLinear(const char *Extension)
+{
+    if (Extension != NULL)
+    {
+        for (size_t I = 0; I < ARRAY_LEN(FileExtensionContentTypeMap); ++I)
+        {
+            if (strcmp(FileExtensionContentTypeMap[I].Extension, Extension) == 0)
+            {
+                return FileExtensionContentTypeMap[I].ContentType;
+            }
+        }
+    }
+
+    return "application/octet-stream";
+}
+
+static const char *const Extensions[] =
+{
+    ".html", ".css", ".js", ".png", ".jpg", ".svg", ".woff2", ".json", ".ico", ".map",
+    ".ts", ".xml", ".txt", ".mp4", ".wasm", ".gif", ".webp", ".zip", ".pdf", ".nope",
+};
+
+static double GetSeconds()
+{
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return Now.tv_sec + Now.tv_nsec / 1e9;
+}
+
+typedef const char *lookup_function(const char *Extension);
+
+static void Measure(const char *Name, lookup_function *Lookup, size_t Iterations)
+{
+    size_t Checksum = 0;
+    double Start    = GetSeconds();
+    for (size_t Iteration = 0; Iteration < Iterations; ++Iteration)
+    {
+        const char *ContentType = Lookup(Extensions[Iteration % ARRAY_LEN(Extensions)]);
+        Checksum += (size_t)ContentType[0];
+    }
+
+    double Elapsed = GetSeconds() - Start;
+    printf("%-8s %8.2f ns/Lookup (Prüfsumme %zu)\n", Name, Elapsed * 1e9 / Iterations, Checksum);
+}
+
+int main(int ArgCount, char **Args)
+{
+    size_t Iterations = ArgCount > 1 ? strtoull(Args[1], NULL, 10) : 10000000;
+    if (Iterations == 0)
+    {
+        fprintf(stderr, "Ungültige Anzahl an Iterationen\n");
+        return 1;
+    }
+
+    // Beide Varianten müssen für alle Endungen der Tabelle dasselbe liefern
+    for (size_t I = 0; I < ARRAY_LEN(FileExtensionContentTypeMap); ++I)
+    {
+        const char *Extension = FileExtensionContentTypeMap[I].Extension;
+        if (Extension[0] == '.' &&
+            strcmp(GetContentTypeForExtension(Extension), GetContentTypeForExtensionLinear(Extension)) != 0)
+        {
+            fprintf(stderr, "Abweichung bei %s\n", Extension);
+            return 1;
+        }
+    }
+
+    Measure("linear", GetContentTypeForExtensionLinear, Iterations);
+    Measure("hash", GetContentTypeForExtension, Iterations);
+    return 0;
+}
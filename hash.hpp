@@ -0,0 +1,111 @@
+// XXH64 nach https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+// Schnell genug, um Dateiinhalte bei jeder Änderung komplett zu hashen; nicht kryptografisch.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+const uint64_t XxPrime1 = 0x9E3779B185EBCA87ull;
+const uint64_t XxPrime2 = 0xC2B2AE3D27D4EB4Full;
+const uint64_t XxPrime3 = 0x165667B19E3779F9ull;
+const uint64_t XxPrime4 = 0x85EBCA77C2B2AE63ull;
+const uint64_t XxPrime5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t XxRotateLeft(uint64_t Value, int Bits)
+{
+    return (Value << Bits) | (Value >> (64 - Bits));
+}
+
+// Little Endian wie auf allen Zielplattformen, memcpy wegen Alignment
+inline uint64_t XxRead64(const unsigned char *At)
+{
+    uint64_t Value;
+    memcpy(&Value, At, sizeof(Value));
+    return Value;
+}
+
+inline uint32_t XxRead32(const unsigned char *At)
+{
+    uint32_t Value;
+    memcpy(&Value, At, sizeof(Value));
+    return Value;
+}
+
+inline uint64_t XxRound(uint64_t Accumulator, uint64_t Input)
+{
+    Accumulator += Input * XxPrime2;
+    Accumulator  = XxRotateLeft(Accumulator, 31);
+    return Accumulator * XxPrime1;
+}
+
+inline uint64_t XxMergeAccumulator(uint64_t Hash, uint64_t Accumulator)
+{
+    Hash ^= XxRound(0, Accumulator);
+    return Hash * XxPrime1 + XxPrime4;
+}
+
+inline uint64_t HashXx64(const void *Data, size_t Size, uint64_t Seed = 0)
+{
+    const unsigned char *At  = (const unsigned char *)Data;
+    const unsigned char *End = At + Size;
+    uint64_t Hash;
+
+    if (Size >= 32)
+    {
+        // Vier unabhängige Akkumulatoren über 32-Byte-Streifen
+        uint64_t Accumulator1 = Seed + XxPrime1 + XxPrime2;
+        uint64_t Accumulator2 = Seed + XxPrime2;
+        uint64_t Accumulator3 = Seed;
+        uint64_t Accumulator4 = Seed - XxPrime1;
+
+        for (; End - At >= 32; At += 32)
+        {
+            Accumulator1 = XxRound(Accumulator1, XxRead64(At));
+            Accumulator2 = XxRound(Accumulator2, XxRead64(At + 8));
+            Accumulator3 = XxRound(Accumulator3, XxRead64(At + 16));
+            Accumulator4 = XxRound(Accumulator4, XxRead64(At + 24));
+        }
+
+        Hash = XxRotateLeft(Accumulator1, 1) + XxRotateLeft(Accumulator2, 7) +
+               XxRotateLeft(Accumulator3, 12) + XxRotateLeft(Accumulator4, 18);
+        Hash = XxMergeAccumulator(Hash, Accumulator1);
+        Hash = XxMergeAccumulator(Hash, Accumulator2);
+        Hash = XxMergeAccumulator(Hash, Accumulator3);
+        Hash = XxMergeAccumulator(Hash, Accumulator4);
+    }
+    else
+    {
+        Hash = Seed + XxPrime5;
+    }
+
+    Hash += (uint64_t)Size;
+
+    for (; End - At >= 8; At += 8)
+    {
+        Hash ^= XxRound(0, XxRead64(At));
+        Hash  = XxRotateLeft(Hash, 27) * XxPrime1 + XxPrime4;
+    }
+
+    if (End - At >= 4)
+    {
+        Hash ^= (uint64_t)XxRead32(At) * XxPrime1;
+        Hash  = XxRotateLeft(Hash, 23) * XxPrime2 + XxPrime3;
+        At += 4;
+    }
+
+    for (; At < End; ++At)
+    {
+        Hash ^= *At * XxPrime5;
+        Hash  = XxRotateLeft(Hash, 11) * XxPrime1;
+    }
+
+    // Avalanche
+    Hash ^= Hash >> 33;
+    Hash *= XxPrime2;
+    Hash ^= Hash >> 29;
+    Hash *= XxPrime3;
+    Hash ^= Hash >> 32;
+    return Hash;
+}
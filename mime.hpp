@@ -2,7 +2,10 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
+#include <strings.h>
 #define ARRAY_LEN(A) (sizeof(A)/sizeof(A[0]))
 
 struct ContentTypeEntry
@@ -11,7 +14,7 @@ struct ContentTypeEntry
     const char *ContentType;
 };
 
-const ContentTypeEntry FileExtensionContentTypeMap[] =
+constexpr ContentTypeEntry FileExtensionContentTypeMap[] =
 {
     {".323", "text/h323"},
     {".3g2", "video/3gpp2"},
@@ -702,15 +705,102 @@ const ContentTypeEntry FileExtensionContentTypeMap[] =
     {"x-world/x-vrml", ".xof"},
 };
 
+//
+// Lookup
+//
+
+// Die Endungen werden zur Kompilierzeit in eine Hashtabelle (Open Addressing, Linear Probing) über
+// FileExtensionContentTypeMap eingetragen. Beim Probing werden nur die 64-Bit-Hashes verglichen; da
+// unten sichergestellt ist, dass keine zwei Endungen denselben Hash haben, bleibt pro Lookup genau
+// ein String-Vergleich zur Bestätigung übrig.
+
+constexpr char ToLowerAscii(char C)
+{
+    return (C >= 'A' && C <= 'Z') ? (char)(C - 'A' + 'a') : C;
+}
+
+// FNV-1a über die Endung in Kleinbuchstaben
+constexpr uint64_t HashExtension(const char *Extension)
+{
+    uint64_t Hash = 14695981039346656037ull;
+    for (const char *At = Extension; *At != '\0'; ++At)
+    {
+        Hash ^= (unsigned char)ToLowerAscii(*At);
+        Hash *= 1099511628211ull;
+    }
+
+    return Hash;
+}
+
+constexpr size_t NumExtensionSlots = 2048;  // Zweierpotenz, Füllgrad ca. 30%
+static_assert((NumExtensionSlots & (NumExtensionSlots - 1)) == 0, "NumExtensionSlots muss eine Zweierpotenz sein");
+static_assert(ARRAY_LEN(FileExtensionContentTypeMap) < NumExtensionSlots / 2, "NumExtensionSlots zu klein");
+
+struct ExtensionSlot
+{
+    uint64_t Hash;
+    uint16_t EntryIndex;  // Index in FileExtensionContentTypeMap + 1, 0 = frei
+};
+
+struct ExtensionTable
+{
+    ExtensionSlot Slots[NumExtensionSlots];
+    bool          HasDuplicateHashes;
+};
+
+constexpr ExtensionTable BuildExtensionTable()
+{
+    ExtensionTable Table{};
+    for (size_t I = 0; I < ARRAY_LEN(FileExtensionContentTypeMap); ++I)
+    {
+        const char *Extension = FileExtensionContentTypeMap[I].Extension;
+        if (Extension[0] != '.')
+        {
+            // Die Einträge am Ende bilden Content-Types auf Endungen ab
+            continue;
+        }
+
+        uint64_t Hash = HashExtension(Extension);
+        size_t   Slot = Hash & (NumExtensionSlots - 1);
+        while (Table.Slots[Slot].EntryIndex != 0)
+        {
+            // Gleicher Hash landet immer auf derselben Probing-Kette, wird also hier gefunden
+            if (Table.Slots[Slot].Hash == Hash) Table.HasDuplicateHashes = true;
+            Slot = (Slot + 1) & (NumExtensionSlots - 1);
+        }
+
+        Table.Slots[Slot].Hash       = Hash;
+        Table.Slots[Slot].EntryIndex = (uint16_t)(I + 1);
+    }
+
+    return Table;
+}
+
+constexpr ExtensionTable ExtensionLookupTable = BuildExtensionTable();
+static_assert(!ExtensionLookupTable.HasDuplicateHashes, "Zwei Endungen haben denselben Hash (oder eine ist doppelt)");
+
 inline const char *GetContentTypeForExtension(const char *Extension)
 {
     if (Extension != NULL)
     {
-        for (int I = 0; I < ARRAY_LEN(FileExtensionContentTypeMap); ++I)
+        uint64_t Hash = HashExtension(Extension);
+        for (size_t Slot = Hash & (NumExtensionSlots - 1);; Slot = (Slot + 1) & (NumExtensionSlots - 1))
         {
-            if (strcmp(FileExtensionContentTypeMap[I].Extension, Extension) == 0)
+            const ExtensionSlot &Candidate = ExtensionLookupTable.Slots[Slot];
+            if (Candidate.EntryIndex == 0)
             {
-                return FileExtensionContentTypeMap[I].ContentType;
+                break;
+            }
+
+            if (Candidate.Hash == Hash)
+            {
+                const ContentTypeEntry &Entry = FileExtensionContentTypeMap[Candidate.EntryIndex - 1];
+                if (strcasecmp(Entry.Extension, Extension) == 0)
+                {
+                    return Entry.ContentType;
+                }
+
+                break;
             }
         }
     }
@@ -4,59 +4,93 @@
 // * HTTP Response Message: https://www.w3.org/Protocols/rfc2616/rfc2616-sec6.html
 
 #define __STDC_WANT_LIB_EXT1__ 1
+#include "hash.hpp"
 #include "mime.hpp"
-
-#include "ws.h"
+#include "sha1.hpp"
 
 #include <arpa/inet.h>
 #include <assert.h>
 #include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <pthread.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <sys/wait.h>
+#include <linux/openat2.h>
 #include <unistd.h>
+#include <zlib.h>
 
 // Konstanten
+const char *const HttpStatusSwitchingProtocols = "101 Switching Protocols";
 const char *const HttpStatusOk               = "200 OK";
 const char *const HttpStatusMovedPermanently = "301 Moved Permanently";
+const char *const HttpStatusPartialContent   = "206 Partial Content";
+const char *const HttpStatusNotModified      = "304 Not Modified";
+const char *const HttpStatusBadRequest      = "400 Bad Request";
 const char *const HttpStatusNotFound         = "404 Not Found";
+const char *const HttpStatusPayloadTooLarge  = "413 Payload Too Large";
+const char *const HttpStatusUriTooLong       = "414 URI Too Long";
+const char *const HttpStatusRangeNotSatisfiable = "416 Range Not Satisfiable";
+const char *const HttpStatusUpgradeRequired  = "426 Upgrade Required";
+const char *const HttpStatusHeaderTooLarge   = "431 Request Header Fields Too Large";
 const char *const HttpStatusInternalError    = "500 Internal Server Error";
+const char *const HttpStatusNotImplemented   = "501 Not Implemented";
+const char *const HttpStatusVersionNotSupported = "505 HTTP Version Not Supported";
 
 const char *const HttpHeaderContentType   = "Content-Type";
 const char *const HttpHeaderContentLength = "Content-Length";
 const char *const HttpHeaderLocation      = "Location";
 
 const char *const Sentinel              = "<body>";
+const char *const WebSocketPath         = "netzsteckdose";  // Wie request::Path, ohne führende '/'
+const char *const ClientScriptPath      = "__livegate/client.js";
+const char *const WebSocketGuid         = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";  // RFC 6455, 1.3
 const char *InterestingFileExtensions[] = { ".html", ".ts", ".css" };
 
 const char *const SassDockerContainerName = "livegate-sass-node";
 
 // CLI Optionen
 char ContentDir[PATH_MAX] = { "." };
+int  ContentDirFd = -1;  // O_PATH, alle Zugriffe auf Inhalte gehen relativ dazu, siehe OpenContentFile()
 int MaxDepth = -1;
 unsigned short Port          = 42250;
-unsigned short WebSocketPort = 42251;
 enum { SassDisabled, SassEnabled, SassDocker } SassMode = SassDisabled;
 bool RunSassInDocker         = false;
 bool RequestLoggingEnabled   = false;
 bool ResponseLoggingEnabled  = false;
+int KeepAliveTimeout         = 5;    // Sekunden
+int MaxRequestsPerConnection = 100;
+int NumWorkers               = 1;
+bool PinWorkersToCpus        = false;
+size_t CacheBudget           = 64 * 1024 * 1024;  // Bytes, 0 = Cache deaktiviert
+bool UsePollingWatcher       = false;
+bool UseTypescriptDaemon     = true;
+bool InlineClientScript      = false;
+bool MorphPages              = false;
+int DebounceMs               = 50;
 
-int ServerFd = -1;
-int ClientFd = -1;
-ws_cli_conn_t *ClientWebSocketConn = NULL;
 pid_t SassWatcherPid = -1;
 
-const char Script[] = R"js(
-<script type="text/javascript">
+// Wird unter ClientScriptPath ausgeliefert oder mit --inline-script direkt in jede Seite eingefügt
+const char ClientScript[] = R"js(
 document.addEventListener("DOMContentLoaded", (event) => {
     var scrollOffset = localStorage.getItem("scrollOffset")
     if (scrollOffset != null) {
@@ -64,45 +98,232 @@ document.addEventListener("DOMContentLoaded", (event) => {
         window.scrollTo(0, scrollOffset)
     }
 
-    let socket = new WebSocket(`ws://localhost:${(window.location.port|0) + 1}/netzsteckdose`)
+    // Gleicher Host und Port wie die Seite, so klappt es auch hinter Port-Weiterleitungen und Proxys
+    let protocol = window.location.protocol === "https:" ? "wss:" : "ws:"
+    let socketUrl = `${protocol}//${window.location.host}/netzsteckdose`
+
+    // Epoche des Servers und zuletzt gesehene Änderung, damit nach einem Verbindungsabbruch
+    // die verpassten Änderungen nachgeliefert werden können
+    let epoch = null
+    let lastSeq = 0
+    let reconnectDelay = 250
+    const maxReconnectDelay = 10000
+
+    function reloadPage() {
+        localStorage.setItem("scrollOffset", window.scrollY)
+        location.reload(true);
+    }
+
+    function connect() {
+        let socket = new WebSocket(socketUrl)
+        socket.onopen = onOpen
+        socket.onmessage = onMessage
+        socket.onclose = onClose
+        socket.onerror = onError
+    }
 
-    socket.onopen = function(event) {
+    function onOpen(event) {
         console.log("[onopen] Verbindung hergestellt; window.location.pathname " + window.location.pathname)
-        socket.send(window.location.pathname)
+        this.send(`${epoch ?? "-"} ${lastSeq} ${window.location.pathname}`)
     }
 
-    socket.onmessage = function(event) {
+    function onMessage(event) {
         console.log("[onmessage] Nachricht empfangen: '" + event.data + "'; window.location.pathname '" + window.location.pathname + "'");
 
-        var changedFilename = event.data
+        var message = JSON.parse(event.data)
+        if (message.type === "hello") {
+            if (epoch !== null && epoch !== message.epoch) {
+                // Neu gestartet - was sich in der Zwischenzeit geändert hat, weiß der Server nicht
+                console.log("[onmessage] Server wurde neu gestartet, lade neu")
+                reloadPage()
+                return
+            }
+
+            if (epoch === null) {
+                lastSeq = message.seq
+            }
+
+            epoch = message.epoch
+            reconnectDelay = 250
+            return
+        }
+
+        if (message.seq <= lastSeq) {
+            return
+        }
+
+        lastSeq = message.seq
+        if (message.type === "morph") {
+            try {
+                morphPage(message.html)
+                console.log(`[onmessage] ${message.paths[0]} ohne Neuladen aktualisiert`)
+            } catch (error) {
+                console.log("[onmessage] Morphing fehlgeschlagen, lade neu: " + error)
+                reloadPage()
+            }
+            return
+        }
+
+        if (message.type === "css") {
+            swapStylesheets(message.paths)
+            return
+        }
+
+        if (message.type !== "reload") {
+            return
+        }
+
         var myFilename = window.location.pathname;
-        var shouldReload =
+        var myScripts = Array.from(document.scripts, script => script.src && new URL(script.src).pathname)
+        var shouldReload = message.paths.some(changedFilename =>
             changedFilename === "*" ||
             myFilename === changedFilename ||
-            myFilename === "" && changedFilename === "index.html" ||
-            myFilename.endsWith("/") && changedFilename === myFilename + "index.html";
+            myScripts.includes(changedFilename) ||
+            myFilename.endsWith("/") && changedFilename === myFilename + "index.html");
 
         if (shouldReload) {
-            localStorage.setItem("scrollOffset", window.scrollY)
-            location.reload(true);
+            reloadPage()
         } else {
-            console.log(`[onmessage]: Lade nicht neu, '${event.data}' ist nicht meine Datei`)
+            console.log(`[onmessage]: Lade nicht neu, keine der Dateien ist meine`)
+        }
+    }
+
+    // Ersetzt die geänderten Stylesheets durch eine Kopie mit neuem Cache-Busting-Token. Das alte
+    // <link> bleibt bis zum Laden des neuen stehen, damit die Seite nicht kurz ungestylt ist.
+    function swapStylesheets(changedPaths) {
+        var links = Array.from(document.querySelectorAll('link[rel="stylesheet"]'))
+        var matching = links.filter(link => changedPaths.includes(new URL(link.href).pathname))
+
+        // Z.B. per @import eingebunden: dann alle austauschen, immer noch billiger als neu laden
+        var toSwap = matching.length > 0 ? matching : links
+        var token = Date.now()
+        for (let link of toSwap) {
+            let url = new URL(link.href)
+            url.searchParams.set("livegate", token)
+
+            let newLink = link.cloneNode()
+            newLink.href = url.href
+            newLink.onload = () => link.remove()
+            newLink.onerror = () => newLink.remove()
+            link.after(newLink)
+        }
+
+        console.log(`[onmessage] ${toSwap.length} Stylesheet(s) ausgetauscht`)
+    }
+
+    // Gleicht das DOM an das neue HTML an (nur mit --morph). Unveränderte Knoten bleiben erhalten, samt
+    // Fokus, Eingaben, Scroll-Position und JS-Zustand. Nur geänderte oder neue Skripte werden ausgeführt.
+    function morphPage(html) {
+        let newDocument = new DOMParser().parseFromString(html, "text/html")
+        morphAttributes(document.documentElement, newDocument.documentElement)
+        morphNode(document.head, newDocument.head)
+        morphNode(document.body, newDocument.body)
+    }
+
+    // Das eingefügte Live-Reload-Skript steht nicht im HTML der Datei und muss bleiben
+    function isLiveGateNode(node) {
+        return node.nodeName === "SCRIPT" && (node.src.includes("/__livegate/") || node.text.includes("/netzsteckdose"))
+    }
+
+    function nextMorphable(node) {
+        while (node !== null && isLiveGateNode(node)) node = node.nextSibling
+        return node
+    }
+
+    function morphAttributes(oldElement, newElement) {
+        for (let attribute of Array.from(oldElement.attributes)) {
+            if (!newElement.hasAttribute(attribute.name)) oldElement.removeAttribute(attribute.name)
+        }
+
+        for (let attribute of Array.from(newElement.attributes)) {
+            if (oldElement.getAttribute(attribute.name) !== attribute.value) oldElement.setAttribute(attribute.name, attribute.value)
+        }
+    }
+
+    // Per DOMParser erzeugte Skripte werden nie ausgeführt, deshalb neu anlegen
+    function executableCopy(node) {
+        let copy = document.importNode(node, true)
+        if (copy.nodeType !== Node.ELEMENT_NODE) return copy
+
+        let scripts = copy.nodeName === "SCRIPT" ? [copy] : Array.from(copy.querySelectorAll("script"))
+        for (let script of scripts) {
+            let fresh = document.createElement("script")
+            for (let attribute of Array.from(script.attributes)) fresh.setAttribute(attribute.name, attribute.value)
+            fresh.text = script.text
+            if (script === copy) return fresh
+            script.replaceWith(fresh)
+        }
+
+        return copy
+    }
+
+    function morphNode(oldNode, newNode) {
+        if (oldNode.nodeType !== newNode.nodeType || oldNode.nodeName !== newNode.nodeName) {
+            oldNode.replaceWith(executableCopy(newNode))
+            return
+        }
+
+        if (oldNode.nodeType !== Node.ELEMENT_NODE) {
+            if (oldNode.nodeValue !== newNode.nodeValue) oldNode.nodeValue = newNode.nodeValue
+            return
+        }
+
+        if (oldNode.nodeName === "SCRIPT") {
+            if (!oldNode.isEqualNode(newNode)) oldNode.replaceWith(executableCopy(newNode))
+            return
+        }
+
+        morphAttributes(oldNode, newNode)
+        morphChildren(oldNode, newNode)
+    }
+
+    function morphChildren(oldParent, newParent) {
+        let oldNode = nextMorphable(oldParent.firstChild)
+        for (let newNode of Array.from(newParent.childNodes)) {
+            // Elemente mit id werden wiedergefunden, auch wenn davor etwas eingefügt oder entfernt wurde
+            if (newNode.id && (oldNode === null || oldNode.id !== newNode.id)) {
+                let match = Array.from(oldParent.children).find(child => child.id === newNode.id)
+                if (match !== undefined) {
+                    oldParent.insertBefore(match, oldNode)
+                    oldNode = match
+                }
+            }
+
+            if (oldNode === null) {
+                oldParent.appendChild(executableCopy(newNode))
+                continue
+            }
+
+            let next = nextMorphable(oldNode.nextSibling)
+            morphNode(oldNode, newNode)
+            oldNode = next
+        }
+
+        while (oldNode !== null) {
+            let next = nextMorphable(oldNode.nextSibling)
+            oldNode.remove()
+            oldNode = next
         }
     }
 
-    socket.onclose = function(event) {
+    // Neu verbinden mit exponentiellem Backoff, z.B. nach Standby oder Neustart des Servers
+    function onClose(event) {
         if (event.wasClean) {
-            console.log("[onclose] Socket sauber geschlossen")
+            console.log(`[onclose] Socket sauber geschlossen, verbinde in ${reconnectDelay} ms neu`)
         } else {
-            console.log("[onclose] Socket unsauber geschlossen")
+            console.log(`[onclose] Socket unsauber geschlossen, verbinde in ${reconnectDelay} ms neu`)
         }
+
+        setTimeout(connect, reconnectDelay)
+        reconnectDelay = Math.min(reconnectDelay * 2, maxReconnectDelay)
     }
 
-    socket.onerror = function(error) {
+    function onError(error) {
         console.log("[onerror] Socket Fehler: " + JSON.stringify(error))
     }
+
+    connect()
 });
-</script>
 )js";
 
 template<typename f> struct deferer
@@ -118,684 +339,5502 @@ template<typename f> deferer<f> operator+(defer_dummy, f &&F) { return deferer<f
 #define DEFER_2(x, y) DEFER_1(x, y)
 #define defer auto DEFER_2(ScopeExit, __LINE__) = defer_dummy{} + [&]()
 
-struct request
+// Nicht nullterminierter Ausschnitt aus einem Buffer, gehört dem Buffer
+struct str
 {
-    char Path[PATH_MAX];
-    char ResolvedPath[PATH_MAX];
+    const char *Data;
+    size_t      Size;
 };
 
-struct header
+#define STR_FMT(S) (int)(S).Size, (S).Data  // Für printf("%.*s", STR_FMT(S))
+
+bool StrEquals(str S, const char *Other)
+{
+    size_t OtherSize = strlen(Other);
+    return S.Size == OtherSize && memcmp(S.Data, Other, OtherSize) == 0;
+}
+
+bool StrEqualsNoCase(str S, const char *Other)
+{
+    size_t OtherSize = strlen(Other);
+    return S.Size == OtherSize && strncasecmp(S.Data, Other, OtherSize) == 0;
+}
+
+const int MaxRequestHeaders = 64;
+
+// Identifiziert einen bestimmten Stand einer Datei. Device und Inode allein reichen nicht, Inodes
+// gelöschter Dateien werden wiederverwendet.
+struct file_version
 {
-    char *Name;    // NOTE: free()
-    char *Value;   // NOTE: free()
-    header *Next;  // NOTE: free() rekursiv
+    dev_t    Device;
+    ino_t    Inode;
+    timespec MTime;
+    off_t    Size;
 };
 
-struct response
+file_version GetFileVersion(const struct stat *Stat)
+{
+    return { Stat->st_dev, Stat->st_ino, Stat->st_mtim, Stat->st_size };
+}
+
+bool IsSameFileVersion(file_version A, file_version B)
+{
+    return
+        A.Device       == B.Device &&
+        A.Inode        == B.Inode &&
+        A.MTime.tv_sec == B.MTime.tv_sec && A.MTime.tv_nsec == B.MTime.tv_nsec &&
+        A.Size         == B.Size;
+}
+
+struct request_header
 {
-    const char *Status;
-    header     *FirstHeader;  // NOTE: free()
-    char       *Content;      // NOTE: free()
-    size_t      ContentSize;
+    str Name;
+    str Value;
 };
 
-void AddHeader(response *Response, const char *Name, const char *Format, ...)
+// Alle str zeigen in den RequestBuffer der Verbindung und sind nur bis FinishRequest() gültig
+struct request
 {
-    header *Header = (header *)malloc(sizeof(header));
+    str Method;
+    str Target;        // Wie in der Request Line, z.B. "/css/main.css?v=3"
+    str Path;          // Dekodiert (in der Arena der Verbindung), ohne führende '/' und ohne Query, z.B. "css/main.css"
+    str Query;         // Ohne '?'
+    int VersionMinor;  // HTTP/1.<VersionMinor>
+
+    request_header Headers[MaxRequestHeaders];
+    int            NumHeaders;
+    size_t         ContentLength;
+
+    char    ResolvedPath[PATH_MAX];
+    file_version ResolvedFileVersion;
+};
 
-    Header->Name  = strdup(Name);
-    Header->Value = (char *)malloc(1024);
-    Header->Next  = NULL;
+const str *FindHeader(const request *Request, const char *Name)
+{
+    for (int I = 0; I < Request->NumHeaders; ++I)
+    {
+        if (StrEqualsNoCase(Request->Headers[I].Name, Name))
+        {
+            return &Request->Headers[I].Value;
+        }
+    }
 
-    va_list VaList;
-    va_start(VaList, Format);
-    vsnprintf(Header->Value, 1024, Format, VaList);
-    va_end(VaList);
+    return NULL;
+}
 
-    if (Response->FirstHeader == NULL)
+// Prüft, ob eine kommaseparierte Header-Liste (z.B. "Connection: keep-alive, Upgrade") Token enthält
+bool HeaderHasToken(const str *Value, const char *Token)
+{
+    if (Value == NULL)
     {
-        Response->FirstHeader = Header;
+        return false;
     }
-    else
+
+    const char *At  = Value->Data;
+    const char *End = Value->Data + Value->Size;
+    while (At < End)
     {
-        header *Last = Response->FirstHeader;
-        while (Last->Next != NULL) Last = Last->Next;
-        Last->Next = Header;
+        while (At < End && (*At == ' ' || *At == '\t' || *At == ',')) ++At;
+        const char *TokenStart = At;
+        while (At < End && *At != ',') ++At;
+        const char *TokenEnd = At;
+        while (TokenEnd > TokenStart && (TokenEnd[-1] == ' ' || TokenEnd[-1] == '\t')) --TokenEnd;
+
+        if (StrEqualsNoCase(str{TokenStart, (size_t)(TokenEnd - TokenStart)}, Token))
+        {
+            return true;
+        }
     }
+
+    return false;
 }
 
-char *ReadEntireContentFile(const char *Filename, size_t *Size = NULL);
-char *ReadEntireFile(const char *Path, size_t *Size = NULL);
-void GetContentFilePath(const char *Filename, char Output[PATH_MAX]);
+// Wachsender, immer nullterminierter Text-Buffer, z.B. für WebSocket-Nachrichten
+struct text_buffer
+{
+    char  *Data;
+    size_t Size;
+    size_t Capacity;
+};
 
-void PrintError(const char *Message, ...)
+// Bump-Allocator für alles, was nur bis zum Ende eines Requests lebt (dekodierter Pfad, Response-Kopf,
+// Multipart-Köpfe). Der Speicher gehört der Verbindung, nach jeder Response wird in O(1) zurückgesetzt,
+// einzeln freigegeben wird nichts. Ist er voll, gibt es NULL statt malloc().
+struct request_arena
 {
-    char Format[1024];
-    snprintf(Format, sizeof(Format), "FEHLER: %s (%s)\n", Message, strerror(errno));
+    char  *Data;
+    size_t Size;
+    size_t Capacity;
+};
 
-    va_list VaList;
-    va_start(VaList, Message);
-    vfprintf(stderr, Format, VaList);
-    va_end(VaList);
+void *ArenaPush(request_arena *Arena, size_t Size)
+{
+    size_t Offset = (Arena->Size + 15) & ~(size_t)15;
+    if (Offset > Arena->Capacity || Size > Arena->Capacity - Offset)
+    {
+        return NULL;
+    }
+
+    Arena->Size = Offset + Size;
+    return Arena->Data + Offset;
 }
 
-void RunCommand(const char *Format, ...)
+// Formatiert direkt in den freien Rest der Arena, *Size ohne den Nullterminator
+char *ArenaPrintf(request_arena *Arena, size_t *Size, const char *Format, ...)
 {
-    char Command[1024];
+    char  *At        = Arena->Data + Arena->Size;
+    size_t Available = Arena->Capacity - Arena->Size;
+
     va_list VaList;
     va_start(VaList, Format);
-    vsnprintf(Command, sizeof(Command), Format, VaList);
+    int Written = vsnprintf(At, Available, Format, VaList);
     va_end(VaList);
 
-    printf("Führe Befehl aus: %s\n", Command);
-    system(Command);
+    if (Written < 0 || (size_t)Written >= Available)
+    {
+        return NULL;
+    }
+
+    Arena->Size += Written + 1;
+    *Size = Written;
+    return At;
 }
 
-//
-// FileWatcher
-//
+enum content_source
+{
+    ContentFromBuffer,  // Content, NOTE: free()
+    ContentFromFile,    // FileFd, wird per sendfile() gesendet
+    ContentFromCache,   // Content zeigt in CacheEntry
+    ContentFromStatic,  // Content zeigt auf statischen Speicher, z.B. ClientScript
+};
 
-struct file_watcher_entry
+struct cache_entry;
+
+const int MaxRanges       = 8;
+const int MaxContentParts = 2 * MaxRanges + 1;  // multipart/byteranges: Kopf und Daten pro Range, Abschluss
+
+// Ein Stück des Inhalts, aus dem Speicher oder bei Data == NULL per sendfile() aus FileFd ab FileOffset
+struct content_part
 {
-    int CTime;
-    char *Path;
+    const char *Data;
+    off_t       FileOffset;
+    size_t      Size;
 };
 
-const char *GetFilenameExtension(const char *Filename)
+const size_t MaxResponseHeadSize = 4096;
+const size_t MaxStatusLineSize   = 64;  // Wird vorne im Kopf freigehalten, siehe FinishResponseHead()
+
+struct response
 {
-    return strrchr(Filename, '.');
+    const char    *Status;
+    content_source ContentSource;
+    char          *Content;      // NOTE: free(), nur bei ContentFromBuffer
+    cache_entry   *CacheEntry;   // NOTE: CacheReleaseFile()
+    int            FileFd;       // NOTE: close()
+    size_t         ContentSize;  // Summe über alle ContentParts
+
+    // Wird nacheinander gesendet, leer heißt { Content, 0, ContentSize }
+    content_part ContentParts[MaxContentParts];
+    int          NumContentParts;
+
+    // Die Header werden beim Hinzufügen direkt so in den Kopf geschrieben, wie sie gesendet werden
+    request_arena *Arena;         // Gehört der Verbindung
+    size_t         ArenaMark;     // Alles ab hier in der Arena gehört der Response
+    char          *Head;          // MaxResponseHeadSize Bytes in der Arena
+    size_t         HeadStart;     // Erst nach FinishResponseHead() gültig
+    size_t         HeadSize;
+    bool           HeadOverflow;  // Ein Header passte nicht mehr, die Response darf so nicht raus
+};
+
+struct notification;
+void NotifyClients(const notification *Notification);
+struct event_loop;
+void AddClient(uint64_t ClientId, event_loop *Loop);
+void RemoveClient(uint64_t ClientId);
+void SubscribeClient(uint64_t ClientId, str PagePath);
+char *ReadEntireContentFile(const char *Filename, size_t *Size = NULL);
+int OpenContentFile(const char *RelativePath, int Flags);
+bool StatContentFile(const char *RelativePath, struct stat *Stat);
+
+void PrintError(const char *Message, ...)
+{
+    char Format[1024];
+    snprintf(Format, sizeof(Format), "FEHLER: %s (%s)\n", Message, strerror(errno));
+
+    va_list VaList;
+    va_start(VaList, Message);
+    vfprintf(stderr, Format, VaList);
+    va_end(VaList);
 }
 
-bool IsInterestingForWatcher(const char *Filename)
+void BeginResponse(response *Response, request_arena *Arena)
 {
-    const char *FilenameExtension = GetFilenameExtension(Filename);
-    if (FilenameExtension == NULL)
+    Response->Arena     = Arena;
+    Response->ArenaMark = Arena->Size;
+    Response->Head      = (char *)ArenaPush(Arena, MaxResponseHeadSize);
+    Response->HeadSize  = MaxStatusLineSize;
+    assert(Response->Head != NULL);
+}
+
+// false, wenn der Header nicht mehr in den Kopf passt. Dann bleibt auch HeadOverflow gesetzt und
+// FinishResponseHead() schlägt fehl, ein fehlender Header geht also nie unbemerkt raus.
+bool AddHeader(response *Response, const char *Name, const char *Format, ...)
+{
+    char  *At        = Response->Head + Response->HeadSize;
+    size_t Available = MaxResponseHeadSize - Response->HeadSize - 2;  // "\r\n" am Ende des Kopfs
+
+    int NameSize = snprintf(At, Available, "%s: ", Name);
+    if (NameSize < 0 || (size_t)NameSize >= Available)
     {
+        PrintError("AddHeader: Kein Platz mehr im Response-Kopf für '%s'", Name);
+        Response->HeadOverflow = true;
         return false;
     }
 
-    for (int I = 0; I < ARRAY_LEN(InterestingFileExtensions); ++I)
+    va_list VaList;
+    va_start(VaList, Format);
+    int ValueSize = vsnprintf(At + NameSize, Available - NameSize, Format, VaList);
+    va_end(VaList);
+
+    if (ValueSize < 0 || (size_t)NameSize + ValueSize + 2 > Available)
     {
-        const char *InterestingExtension = InterestingFileExtensions[I];
-        if (strcmp(FilenameExtension, InterestingExtension) == 0)
-        {
-            return true;
-        }
+        PrintError("AddHeader: Kein Platz mehr im Response-Kopf für '%s'", Name);
+        Response->HeadOverflow = true;
+        return false;
     }
 
-    return false;
+    memcpy(At + NameSize + ValueSize, "\r\n", 2);
+    Response->HeadSize += NameSize + ValueSize + 2;
+    return true;
 }
 
-bool NotifyClientFileChanged(const char *Filename)
+// Setzt die Status-Zeile in den freigehaltenen Platz direkt vor die Header, der Kopf ist dann
+// ohne Umkopieren zusammenhängend: Head[HeadStart, HeadSize). false, wenn ein Header gefehlt hat.
+bool FinishResponseHead(response *Response)
 {
-    if (ClientWebSocketConn == NULL)
+    if (Response->HeadOverflow)
     {
-        PrintError("Es ist keine WebSocket-Verbindung offen, kann den Client nicht über die Änderung benachrichtigen.\n");
         return false;
     }
 
-    ws_sendframe_txt(ClientWebSocketConn, Filename);
+    char StatusLine[MaxStatusLineSize];
+    int  StatusLineSize = snprintf(StatusLine, sizeof(StatusLine), "HTTP/1.1 %s\r\n", Response->Status);
+    assert(StatusLineSize > 0 && (size_t)StatusLineSize < sizeof(StatusLine));
+
+    Response->HeadStart = MaxStatusLineSize - StatusLineSize;
+    memcpy(Response->Head + Response->HeadStart, StatusLine, StatusLineSize);
+    memcpy(Response->Head + Response->HeadSize, "\r\n", 2);
+    Response->HeadSize += 2;
     return true;
 }
 
-bool WatcherWalkDir(const char *DirPath, file_watcher_entry *Entries, size_t NumEntries, int Depth = 0)
+void RunCommand(const char *Format, ...)
 {
-    //for (int I = 0; I < Depth; ++I) printf("....");
-    //printf("Scanne Verzeichnis %s\n", DirPath);
+    char Command[1024];
+    va_list VaList;
+    va_start(VaList, Format);
+    vsnprintf(Command, sizeof(Command), Format, VaList);
+    va_end(VaList);
 
-    DIR *Dir = opendir(DirPath);
-    if (Dir == NULL)
+    printf("Führe Befehl aus: %s\n", Command);
+    system(Command);
+}
+
+uint64_t GetMonotonicMs()
+{
+    timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (uint64_t)Now.tv_sec * 1000 + Now.tv_nsec / 1000000;
+}
+
+void TextAppend(text_buffer *Buffer, const char *Data, size_t Size)
+{
+    if (Buffer->Size + Size + 1 > Buffer->Capacity)
     {
-        PrintError("Konnte das Verzeichnis '%s' nicht öffnen.", DirPath);
-        return false;
+        size_t NewCapacity = Buffer->Capacity == 0 ? 256 : Buffer->Capacity * 2;
+        while (NewCapacity < Buffer->Size + Size + 1) NewCapacity *= 2;
+
+        Buffer->Data     = (char *)realloc(Buffer->Data, NewCapacity);
+        Buffer->Capacity = NewCapacity;
     }
 
-    defer { closedir(Dir); Dir = NULL; };
+    memcpy(Buffer->Data + Buffer->Size, Data, Size);
+    Buffer->Size += Size;
+    Buffer->Data[Buffer->Size] = '\0';
+}
 
+void TextAppend(text_buffer *Buffer, const char *Text)
+{
+    TextAppend(Buffer, Text, strlen(Text));
+}
 
-    for (dirent *Ent; (Ent = readdir(Dir));)
+// WebSocket-Textnachrichten müssen gültiges UTF-8 sein (RFC 3629: keine Overlongs, keine Surrogates)
+bool IsValidUtf8(const char *Data, size_t Size)
+{
+    const unsigned char *At  = (const unsigned char *)Data;
+    const unsigned char *End = At + Size;
+    while (At < End)
     {
-        const char *Filename = Ent->d_name;
-        if (strcmp(Filename, ".") == 0 || strcmp(Filename, "..") == 0)
+        unsigned char C = *At++;
+        if (C < 0x80) continue;
+
+        int      NumContinuation;
+        uint32_t CodePoint;
+        if      (C >= 0xC2 && C <= 0xDF) { NumContinuation = 1; CodePoint = C & 0x1F; }
+        else if (C >= 0xE0 && C <= 0xEF) { NumContinuation = 2; CodePoint = C & 0x0F; }
+        else if (C >= 0xF0 && C <= 0xF4) { NumContinuation = 3; CodePoint = C & 0x07; }
+        else return false;
+
+        if (End - At < NumContinuation) return false;
+        for (int I = 0; I < NumContinuation; ++I)
         {
-            continue;
+            if ((At[I] & 0xC0) != 0x80) return false;
+            CodePoint = (CodePoint << 6) | (At[I] & 0x3F);
         }
 
-        char Path[PATH_MAX];
-        snprintf(Path, sizeof(Path), "%s/%s", DirPath, Filename);
-        realpath(Path, Path);
-        char *RelativePath = Path + strlen(ContentDir);
+        At += NumContinuation;
+        if (NumContinuation == 2 && (CodePoint < 0x800 || (CodePoint >= 0xD800 && CodePoint <= 0xDFFF))) return false;
+        if (NumContinuation == 3 && (CodePoint < 0x10000 || CodePoint > 0x10FFFF))                          return false;
+    }
 
-        struct stat Stat;
-        stat(Path, &Stat);
-        if (S_ISDIR(Stat.st_mode))
+    return true;
+}
+
+// Hängt Text als JSON-String inklusive Anführungszeichen an
+void TextAppendJsonString(text_buffer *Buffer, const char *Text)
+{
+    TextAppend(Buffer, "\"", 1);
+    for (const char *At = Text; *At != '\0'; ++At)
+    {
+        unsigned char C = *At;
+        if (C == '"' || C == '\\')
         {
-            if (MaxDepth == -1 || Depth < MaxDepth)
-            {
-                WatcherWalkDir(Path, Entries, NumEntries, Depth + 1);
-            }
+            char Escaped[2] = { '\\', (char)C };
+            TextAppend(Buffer, Escaped, 2);
+        }
+        else if (C < 0x20)
+        {
+            char Escaped[8];
+            snprintf(Escaped, sizeof(Escaped), "\\u%04x", C);
+            TextAppend(Buffer, Escaped, 6);
         }
         else
         {
-            if (!IsInterestingForWatcher(Filename))
-            {
-                continue;
-            }
+            TextAppend(Buffer, At, 1);
+        }
+    }
 
-            file_watcher_entry *FoundEntry = NULL;
-            for (int I = 0; I < NumEntries; ++I)
-            {
-                file_watcher_entry *Entry = &Entries[I];
-                if (Entry->Path == NULL) continue;
+    TextAppend(Buffer, "\"", 1);
+}
 
-                if (strcmp(Entry->Path, Path) == 0)
-                {
-                    FoundEntry = Entry;
-                    break;
-                }
-            }
+// Eine Änderungsmeldung, bevor sie pro Client gefiltert und als JSON verschickt wird (siehe NotifyClients())
+struct notification
+{
+    const char *Type;   // "reload" oder "css", statisch
+    text_buffer Paths;  // Relativ zu ContentDir mit führendem '/', jeweils nullterminiert hintereinander
+    size_t      NumPaths;
+};
 
-            if (FoundEntry != NULL)
-            {
-                bool FileChanged = FoundEntry->CTime != Stat.st_ctime;
-                if (FileChanged)
-                {
-                    printf("Datei %s geändert! %d vs %d\n", RelativePath, (int)Stat.st_ctime, (int)FoundEntry->CTime);
-                    FoundEntry->CTime = Stat.st_ctime;
-
-                    bool IsTypescript = strcmp(GetFilenameExtension(Filename), ".ts") == 0;
-                    bool IsCss        = strcmp(GetFilenameExtension(Filename), ".css") == 0;
-                    bool ShouldReloadAll = IsTypescript || IsCss;
-                    if (IsTypescript)
-                    {
-                        printf("Kompiliere TypeScript...\n");
-                        RunCommand("tsc");
-                        printf("...fertig.\n");
-                    }
-
-                    NotifyClientFileChanged(ShouldReloadAll ? "*" : RelativePath);
-                }
-            }
-            else
-            {
-                printf("Neue Datei %s!\n", Path);
+void AddNotificationPath(notification *Notification, const char *Path)
+{
+    TextAppend(&Notification->Paths, Path, strlen(Path) + 1);
+    ++Notification->NumPaths;
+}
 
-                // Freien Slot finden und file_watcher_entry erstellen
-                bool FreeSlotFound = false;
-                for (int I = 0; I < NumEntries; ++I)
-                {
-                    file_watcher_entry *Entry = &Entries[I];
-
-                    bool IsFree = Entry->Path == NULL;
-                    if (IsFree)
-                    {
-                        FreeSlotFound = true;
-                        Entry->Path  = strdup(Path);
-                        Entry->CTime = Stat.st_ctime;
-                        break;
-                    }
-                }
+// Zum Iterieren: for (const char *Path = FirstPath(..); Path != NULL; Path = NextPath(.., Path))
+const char *FirstNotificationPath(const notification *Notification)
+{
+    return Notification->NumPaths == 0 ? NULL : Notification->Paths.Data;
+}
 
-                if (!FreeSlotFound)
-                {
-                    PrintError("Konnte keinen freien Slot mehr finden - bitte Anzahl der allokierten Slots erhöhen oder die maximale Verzeichnistiefe reduzieren");
-                    return false;
-                }
-            }
-        }
-    }
+const char *NextNotificationPath(const notification *Notification, const char *Path)
+{
+    const char *Next = Path + strlen(Path) + 1;
+    return Next < Notification->Paths.Data + Notification->Paths.Size ? Next : NULL;
+}
 
-    // TODO Gelöschte Dateien entfernen
+bool IsSameNotification(const notification *A, const notification *B)
+{
+    return strcmp(A->Type, B->Type) == 0 && A->Paths.Size == B->Paths.Size && memcmp(A->Paths.Data, B->Paths.Data, A->Paths.Size) == 0;
+}
 
-    return true;
+notification CopyNotification(const notification *Notification)
+{
+    notification Copy = {};
+    Copy.Type     = Notification->Type;
+    Copy.NumPaths = Notification->NumPaths;
+    TextAppend(&Copy.Paths, Notification->Paths.Data, Notification->Paths.Size);
+    return Copy;
 }
 
-void *FileWatcherThreadCallback(void *Arg)
+void FreeNotification(notification *Notification)
 {
-    bool *IsRunning = (bool *)Arg;
-    size_t NumEntries = 1000;
-    file_watcher_entry *Entries = (file_watcher_entry *)malloc(sizeof(file_watcher_entry) * NumEntries);
-    defer
-    {
-        for (int I = 0; I < NumEntries; ++I) free(Entries[I].Path);
-        free(Entries); Entries = NULL;
-    };
+    free(Notification->Paths.Data);
+    *Notification = {};
+}
 
-    printf("File-Watcher gestartet.\n");
+// Was hinter den Sentinel kommt: normalerweise nur ein <script src>, das Skript selbst cacht der Browser.
+// Der Hash in der URL ändert sich mit dem Skript, deshalb darf es beliebig lange gecacht werden.
+text_buffer ClientScriptTag;
+uint64_t    ClientScriptTagHash;   // Geht in die ETags von HTML-Dateien ein
+char        ClientScriptETag[19];  // "<XXH64 hex>" inklusive Anführungszeichen
 
-    while (*IsRunning)
-    {
-        if (!WatcherWalkDir(ContentDir, Entries, NumEntries))
-        {
-            PrintError("Es gab einen Fehler beim Scannen der Verzeichnisstruktur.");
-            return NULL;
-        }
+//
+// Content-Cache
+//
 
-        usleep(50 * 1000);
+// Merkt sich aufgelöste Request-Pfade (auch 404 und Weiterleitungen) und die Inhalte kleiner Dateien,
+// damit Requests im Normalfall das Dateisystem gar nicht anfassen. Invalidiert wird vom File-Watcher:
+// * Auflösungen gelten nur für eine ResolutionGeneration. Sobald der Watcher sieht, dass eine Datei
+//   oder ein Verzeichnis angelegt, gelöscht oder umbenannt wurde, wird die Generation erhöht.
+// * Reine Inhaltsänderungen erhöhen nur die FileVersionGeneration. Das Ergebnis der Auflösung bleibt
+//   gültig, nur der gemerkte Dateistand wird beim nächsten Abruf einmal per stat() erneuert.
+// * Dateiinhalte sind über (Device, Inode) adressiert und werden verworfen, sobald der Watcher für
+//   den Inode eine andere mtime oder Größe sieht. Beim Abruf muss außerdem die FileVersion aus der
+//   Auflösung passen, falls der Inode einer gelöschten Datei schon wiederverwendet wurde.
+// * Komprimierte Fassungen (gzip, deflate) sind zusätzlich über das Encoding adressiert und werden
+//   genauso verworfen, komprimiert wird also nur einmal pro Dateistand.
+//
+// Der Cache ist in Shards mit eigenem Mutex, eigener LRU-Liste und eigenem Byte-Budget aufgeteilt,
+// damit sich die Worker-Threads nicht gegenseitig blockieren.
+
+enum ResolveRequestFilePathResult { RequestedFileNotFound, RequestedFileFound, RedirectToDirectory };
+
+const int    NumCacheShards    = 16;
+const int    NumCacheBuckets   = 256;  // Pro Shard
+const size_t MaxCachedFileSize = 2 * 1024 * 1024;
+
+// Hinter dieser Stelle im HTML wird das Skript eingefügt, NoInjectionOffset wenn der Sentinel fehlt
+const size_t NoInjectionOffset      = (size_t)-1;
+const size_t UnknownInjectionOffset = (size_t)-2;
+
+enum cache_entry_kind { CacheEntryResolution, CacheEntryFile };
+
+enum content_encoding { EncodingIdentity, EncodingGzip, EncodingDeflate };
+
+struct cache_entry
+{
+    cache_entry     *HashNext;
+    cache_entry     *LruPrev;
+    cache_entry     *LruNext;
+    cache_entry_kind Kind;
+    uint64_t         Hash;
+    size_t           Cost;      // Zählt gegen das Byte-Budget des Shards
+    int              RefCount;  // 1 solange im Cache, +1 pro Response, die gerade daraus sendet
+
+    // CacheEntryResolution - Key: RequestPath
+    char                        *RequestPath;   // NOTE: free()
+    size_t                       RequestPathSize;
+    uint64_t                     Generation;
+    uint64_t                     FileVersionGeneration;  // Für FileVersion
+    ResolveRequestFilePathResult Result;
+    char                        *ResolvedPath;  // NOTE: free()
+
+    // CacheEntryFile - Key: (Device, Inode, Encoding), Inhalt gilt nur für genau diese FileVersion
+    // Auch bei CacheEntryResolution gesetzt, damit der Inhalt ohne stat() gefunden wird
+    file_version     FileVersion;
+    content_encoding Encoding;
+    char            *Content;  // NOTE: free(), bei EncodingIdentity FileVersion.Size Bytes + '\0'
+    size_t           ContentSize;
+    size_t           InjectionOffset;  // Für HTML, siehe GetInjectionOffset()
+};
+
+struct cache_shard
+{
+    pthread_mutex_t Mutex;
+    cache_entry    *Buckets[NumCacheBuckets];
+    cache_entry    *LruFirst;  // Zuletzt verwendet
+    cache_entry    *LruLast;   // Wird als erstes verdrängt
+    size_t          Bytes;
+};
+
+cache_shard CacheShards[NumCacheShards];
+uint64_t    ResolutionGeneration  = 1;  // NOTE: __atomic
+uint64_t    FileVersionGeneration = 1;  // NOTE: __atomic
+
+uint64_t HashBytes(const void *Data, size_t Size, uint64_t Hash = 14695981039346656037ull)
+{
+    // FNV-1a
+    const unsigned char *Bytes = (const unsigned char *)Data;
+    for (size_t I = 0; I < Size; ++I)
+    {
+        Hash ^= Bytes[I];
+        Hash *= 1099511628211ull;
     }
 
-    printf("File-Watcher gestoppt.\n");
+    return Hash;
+}
+
+uint64_t HashFileKey(const file_version &FileVersion, content_encoding Encoding = EncodingIdentity)
+{
+    uint64_t Hash = HashBytes(&FileVersion.Device, sizeof(FileVersion.Device), CacheEntryFile);
+    Hash = HashBytes(&FileVersion.Inode, sizeof(FileVersion.Inode), Hash);
+    return Encoding == EncodingIdentity ? Hash : HashBytes(&Encoding, sizeof(Encoding), Hash);
+}
+
+cache_entry *FindFileEntryLocked(cache_shard *Shard, uint64_t Hash, const file_version &FileVersion, content_encoding Encoding = EncodingIdentity)
+{
+    for (cache_entry *Entry = Shard->Buckets[(Hash / NumCacheShards) % NumCacheBuckets]; Entry != NULL; Entry = Entry->HashNext)
+    {
+        bool Matches =
+            Entry->Hash == Hash &&
+            Entry->Kind == CacheEntryFile &&
+            Entry->Encoding == Encoding &&
+            Entry->FileVersion.Device == FileVersion.Device &&
+            Entry->FileVersion.Inode  == FileVersion.Inode;
+
+        if (Matches) return Entry;
+    }
 
     return NULL;
 }
 
-//
-// SASS-Watcher
-//
+void InitCache()
+{
+    for (int I = 0; I < NumCacheShards; ++I)
+    {
+        pthread_mutex_init(&CacheShards[I].Mutex, NULL);
+    }
+}
 
-void StartSassWatcher()
+cache_shard *GetCacheShard(uint64_t Hash)
 {
-    if (SassWatcherPid != -1)
+    return &CacheShards[Hash % NumCacheShards];
+}
+
+void FreeCacheEntry(cache_entry *Entry)
+{
+    free(Entry->RequestPath);
+    free(Entry->ResolvedPath);
+    free(Entry->Content);
+    free(Entry);
+}
+
+// Alle Cache-Funktionen mit "Locked" im Namen erwarten, dass der Shard-Mutex gehalten wird
+
+void LruUnlinkLocked(cache_shard *Shard, cache_entry *Entry)
+{
+    if (Entry->LruPrev != NULL) Entry->LruPrev->LruNext = Entry->LruNext;
+    else                        Shard->LruFirst         = Entry->LruNext;
+    if (Entry->LruNext != NULL) Entry->LruNext->LruPrev = Entry->LruPrev;
+    else                        Shard->LruLast          = Entry->LruPrev;
+
+    Entry->LruPrev = Entry->LruNext = NULL;
+}
+
+void LruPushFrontLocked(cache_shard *Shard, cache_entry *Entry)
+{
+    Entry->LruPrev = NULL;
+    Entry->LruNext = Shard->LruFirst;
+    if (Shard->LruFirst != NULL) Shard->LruFirst->LruPrev = Entry;
+    else                         Shard->LruLast           = Entry;
+    Shard->LruFirst = Entry;
+}
+
+// Entfernt den Eintrag aus dem Cache. Gibt true zurück, wenn er danach freigegeben werden muss.
+bool RemoveCacheEntryLocked(cache_shard *Shard, cache_entry *Entry)
+{
+    cache_entry **Link = &Shard->Buckets[(Entry->Hash / NumCacheShards) % NumCacheBuckets];
+    while (*Link != Entry) Link = &(*Link)->HashNext;
+    *Link = Entry->HashNext;
+
+    LruUnlinkLocked(Shard, Entry);
+    Shard->Bytes -= Entry->Cost;
+
+    return --Entry->RefCount == 0;
+}
+
+cache_entry *FindResolutionEntryLocked(cache_shard *Shard, uint64_t Hash, const char *RequestPath, size_t RequestPathSize)
+{
+    for (cache_entry *Entry = Shard->Buckets[(Hash / NumCacheShards) % NumCacheBuckets]; Entry != NULL; Entry = Entry->HashNext)
     {
-        PrintError("SassWatcher bereits gestartet!");
-        return;
+        bool Matches =
+            Entry->Hash == Hash &&
+            Entry->Kind == CacheEntryResolution &&
+            Entry->RequestPathSize == RequestPathSize &&
+            memcmp(Entry->RequestPath, RequestPath, RequestPathSize) == 0;
+
+        if (Matches) return Entry;
     }
 
-    if (SassMode == SassDisabled)
+    return NULL;
+}
+
+// Zwei Threads können nach einem Fehlschlag gleichzeitig denselben Eintrag anlegen, deshalb wird unter
+// dem Lock noch einmal gesucht. Ein gleichwertiger Eintrag gewinnt, Entry wird dann verworfen.
+// Gibt den Eintrag zurück, der danach im Cache steht. Bei Dateien trägt er wie Entry (RefCount 2)
+// eine Referenz für den Aufrufer.
+cache_entry *InsertCacheEntry(cache_entry *Entry)
+{
+    cache_shard *Shard = GetCacheShard(Entry->Hash);
+    size_t ShardBudget = CacheBudget / NumCacheShards;
+
+    cache_entry *Evicted = NULL;  // Über HashNext verkettet, wird nach dem Unlock freigegeben
+
+    pthread_mutex_lock(&Shard->Mutex);
+
+    cache_entry *Existing;
+    bool KeepExisting;
+    if (Entry->Kind == CacheEntryResolution)
     {
-        return;
+        // Eine Auflösung aus einer älteren Generation wird ersetzt
+        Existing = FindResolutionEntryLocked(Shard, Entry->Hash, Entry->RequestPath, Entry->RequestPathSize);
+        KeepExisting = Existing != NULL && Existing->Generation >= Entry->Generation;
+    }
+    else
+    {
+        Existing = FindFileEntryLocked(Shard, Entry->Hash, Entry->FileVersion, Entry->Encoding);
+        KeepExisting = Existing != NULL && IsSameFileVersion(Existing->FileVersion, Entry->FileVersion);
     }
 
-    printf("Starte den SASS-Watcher.\n");
+    if (KeepExisting)
+    {
+        if (Existing->Kind == CacheEntryFile) ++Existing->RefCount;
+        LruUnlinkLocked(Shard, Existing);
+        LruPushFrontLocked(Shard, Existing);
+        pthread_mutex_unlock(&Shard->Mutex);
 
-    SassWatcherPid = fork();
-    if (SassWatcherPid == 0)
+        FreeCacheEntry(Entry);
+        return Existing;
+    }
+
+    if (Existing != NULL && RemoveCacheEntryLocked(Shard, Existing))
     {
-        // Child process
+        Existing->HashNext = Evicted;
+        Evicted = Existing;
+    }
 
-        const char *SassMapFilename = "sass-map.txt";
-        char *SassMap = ReadEntireContentFile(SassMapFilename);
-        if (SassMap == NULL)
+    cache_entry **Bucket = &Shard->Buckets[(Entry->Hash / NumCacheShards) % NumCacheBuckets];
+    Entry->HashNext = *Bucket;
+    *Bucket = Entry;
+    LruPushFrontLocked(Shard, Entry);
+    Shard->Bytes += Entry->Cost;
+
+    // Am längsten nicht verwendete Einträge verdrängen, bis das Budget wieder passt
+    while (Shard->Bytes > ShardBudget && Shard->LruLast != Entry)
+    {
+        cache_entry *Victim = Shard->LruLast;
+        if (RemoveCacheEntryLocked(Shard, Victim))
         {
-            SassMap = strdup("scss/:css/");
-            printf("%s nicht gefunden, verwende Fallback-Map '%s'\n", SassMapFilename, SassMap);
+            Victim->HashNext = Evicted;
+            Evicted = Victim;
         }
+    }
 
-        defer { free(SassMap); SassMap = NULL; };
+    pthread_mutex_unlock(&Shard->Mutex);
 
-        if (SassMode == SassDocker)
+    while (Evicted != NULL)
+    {
+        cache_entry *Next = Evicted->HashNext;
+        FreeCacheEntry(Evicted);
+        Evicted = Next;
+    }
+
+    return Entry;
+}
+
+//
+// Aufgelöste Request-Pfade
+//
+
+bool CacheLookupResolution(str RequestPath, ResolveRequestFilePathResult *Result, char ResolvedPath[PATH_MAX], file_version *FileVersion)
+{
+    if (CacheBudget == 0)
+    {
+        return false;
+    }
+
+    uint64_t Hash = HashBytes(RequestPath.Data, RequestPath.Size, CacheEntryResolution);
+    uint64_t Generation = __atomic_load_n(&ResolutionGeneration, __ATOMIC_ACQUIRE);
+    uint64_t VersionGeneration = __atomic_load_n(&FileVersionGeneration, __ATOMIC_ACQUIRE);
+    cache_shard *Shard = GetCacheShard(Hash);
+    cache_entry *Stale = NULL;
+    cache_entry *Outdated = NULL;  // Dateistand muss erneuert werden, mit Referenz
+    bool Found = false;
+
+    pthread_mutex_lock(&Shard->Mutex);
+
+    cache_entry *Entry = FindResolutionEntryLocked(Shard, Hash, RequestPath.Data, RequestPath.Size);
+    if (Entry != NULL && Entry->Generation != Generation)
+    {
+        if (RemoveCacheEntryLocked(Shard, Entry)) Stale = Entry;
+    }
+    else if (Entry != NULL)
+    {
+        *Result = Entry->Result;
+        *FileVersion = Entry->FileVersion;
+        if (Entry->ResolvedPath != NULL) strncpy(ResolvedPath, Entry->ResolvedPath, PATH_MAX);
+
+        if (Entry->Result == RequestedFileFound && Entry->FileVersionGeneration != VersionGeneration)
         {
-            char Pwd[PATH_MAX];
-            getcwd(Pwd, sizeof(Pwd));
+            ++Entry->RefCount;
+            Outdated = Entry;
+        }
 
-            RunCommand(
-                "docker run --rm -d -it --name %s -v %s:/sass node bash -c 'npm install -g sass && cd /sass && sass --watch %s'",
-                SassDockerContainerName,
-                Pwd,
-                SassMap);
-            RunCommand(
-                "docker logs --follow %s",
-                SassDockerContainerName);
+        LruUnlinkLocked(Shard, Entry);
+        LruPushFrontLocked(Shard, Entry);
+        Found = true;
+    }
+
+    pthread_mutex_unlock(&Shard->Mutex);
+
+    if (Stale != NULL) FreeCacheEntry(Stale);
+
+    if (Outdated != NULL)
+    {
+        // Eine Datei im Baum wurde geändert, vielleicht diese: nur den Dateistand neu holen
+        struct stat Stat;
+        bool IsFile = StatContentFile(ResolvedPath, &Stat) && S_ISREG(Stat.st_mode);
+
+        pthread_mutex_lock(&Shard->Mutex);
+        if (IsFile)
+        {
+            Outdated->FileVersion           = GetFileVersion(&Stat);
+            Outdated->FileVersionGeneration = VersionGeneration;
+            *FileVersion                    = Outdated->FileVersion;
         }
         else
         {
-            assert(SassMode == SassEnabled);
-            RunCommand("sass --watch %s", SassMap);
+            // Doch gelöscht oder ersetzt, das Event dazu kommt noch: neu auflösen
+            Outdated->Generation = 0;
+            Found = false;
         }
+        bool ShouldFree = --Outdated->RefCount == 0;
+        pthread_mutex_unlock(&Shard->Mutex);
+
+        if (ShouldFree) FreeCacheEntry(Outdated);
     }
-    else if (SassWatcherPid > 0)
+
+    return Found;
+}
+
+// Generation muss vor dem Auflösen gelesen werden, damit eine gleichzeitige Änderung nicht verloren geht
+void CacheStoreResolution(str RequestPath, uint64_t Generation, uint64_t VersionGeneration, ResolveRequestFilePathResult Result, const char *ResolvedPath, file_version FileVersion)
+{
+    if (CacheBudget == 0)
     {
-        // Parent process
         return;
     }
-    else
-    {
-        PrintError("SASS-Watcher: fork() fehlgeschlagen");
-    }
+
+    cache_entry *Entry = (cache_entry *)calloc(1, sizeof(cache_entry));
+    Entry->Kind                  = CacheEntryResolution;
+    Entry->Hash                  = HashBytes(RequestPath.Data, RequestPath.Size, CacheEntryResolution);
+    Entry->RefCount              = 1;
+    Entry->RequestPath           = strndup(RequestPath.Data, RequestPath.Size);
+    Entry->RequestPathSize       = RequestPath.Size;
+    Entry->Generation            = Generation;
+    Entry->FileVersionGeneration = VersionGeneration;
+    Entry->Result                = Result;
+    Entry->ResolvedPath          = Result == RequestedFileFound ? strdup(ResolvedPath) : NULL;
+    Entry->FileVersion           = FileVersion;
+    Entry->Cost                  = sizeof(cache_entry) + RequestPath.Size + (Entry->ResolvedPath ? strlen(ResolvedPath) : 0);
+
+    InsertCacheEntry(Entry);
+}
+
+// Vom Watcher aufgerufen, wenn Dateien oder Verzeichnisse angelegt, gelöscht oder umbenannt wurden
+void CacheInvalidateResolutions()
+{
+    __atomic_add_fetch(&ResolutionGeneration, 1, __ATOMIC_RELEASE);
+}
+
+// Vom Watcher aufgerufen, wenn sich nur Inhalte oder Attribute von Dateien geändert haben
+void CacheInvalidateFileVersions()
+{
+    __atomic_add_fetch(&FileVersionGeneration, 1, __ATOMIC_RELEASE);
 }
 
 //
-// Hilfsfunktionen
+// Dateiinhalte
 //
 
-void WriteEntireBuffer(int Fd, const char *Buffer, size_t BufferSize)
+// Sucht einen Eintrag für genau diesen Dateistand und nimmt eine Referenz darauf, veraltete Einträge fliegen raus
+cache_entry *CacheFindFile(file_version FileVersion, content_encoding Encoding)
+{
+    uint64_t Hash = HashFileKey(FileVersion, Encoding);
+    cache_shard *Shard = GetCacheShard(Hash);
+
+    cache_entry *Stale = NULL;
+
+    pthread_mutex_lock(&Shard->Mutex);
+    cache_entry *Found = FindFileEntryLocked(Shard, Hash, FileVersion, Encoding);
+    if (Found != NULL && !IsSameFileVersion(Found->FileVersion, FileVersion))
+    {
+        if (RemoveCacheEntryLocked(Shard, Found)) Stale = Found;
+        Found = NULL;
+    }
+
+    if (Found != NULL)
+    {
+        ++Found->RefCount;
+        LruUnlinkLocked(Shard, Found);
+        LruPushFrontLocked(Shard, Found);
+    }
+    pthread_mutex_unlock(&Shard->Mutex);
+
+    if (Stale != NULL) FreeCacheEntry(Stale);
+
+    return Found;
+}
+
+// Liefert den Inhalt der Datei (relativ zu ContentDir) mit einer Referenz, die mit CacheReleaseFile()
+// freigegeben werden muss.
+// NULL, wenn die Datei nicht gecacht werden kann (zu groß, Cache deaktiviert, Lesefehler).
+cache_entry *CacheAcquireFile(const char *Path, file_version FileVersion)
 {
-    int Position = 0;
-    while (Position <= BufferSize)
+    if (CacheBudget == 0)
+    {
+        return NULL;
+    }
+
+    cache_entry *Found = CacheFindFile(FileVersion, EncodingIdentity);
+    if (Found != NULL)
+    {
+        return Found;
+    }
+
+    // Nicht im Cache: ohne Lock lesen. Falls sich die Datei dabei ändert, sieht der Watcher beim
+    // nächsten Durchlauf eine andere mtime und wirft den Eintrag wieder raus.
+    int FileFd = OpenContentFile(Path, O_RDONLY);
+    if (FileFd == -1)
+    {
+        return NULL;
+    }
+
+    defer { close(FileFd); };
+
+    struct stat Stat;
+    if (fstat(FileFd, &Stat) != 0 || !S_ISREG(Stat.st_mode) || (size_t)Stat.st_size > MaxCachedFileSize)
+    {
+        return NULL;
+    }
+
+    size_t FileSize = Stat.st_size;
+    char  *Content  = (char *)malloc(FileSize + 1);
+    for (size_t Position = 0; Position < FileSize;)
     {
-        int Written = write(Fd, &Buffer[Position], BufferSize - Position);
-        if (Written == 0)
+        ssize_t BytesRead = read(FileFd, &Content[Position], FileSize - Position);
+        if (BytesRead <= 0)
         {
-            return;
+            if (BytesRead == -1 && errno == EINTR) continue;
+
+            PrintError("CacheAcquireFile: Konnte %s nicht lesen", Path);
+            free(Content);
+            return NULL;
         }
 
-        Position += Written;
+        Position += BytesRead;
+    }
+
+    Content[FileSize] = '\0';
+
+    // Key ist der tatsächlich gelesene Stand, falls die Datei inzwischen ersetzt wurde
+    cache_entry *Entry = (cache_entry *)calloc(1, sizeof(cache_entry));
+    Entry->Kind            = CacheEntryFile;
+    Entry->FileVersion     = GetFileVersion(&Stat);
+    Entry->Hash            = HashFileKey(Entry->FileVersion);
+    Entry->RefCount        = 2;  // Cache + Aufrufer
+    Entry->Content         = Content;
+    Entry->ContentSize     = FileSize;
+    Entry->InjectionOffset = UnknownInjectionOffset;
+    Entry->Cost            = sizeof(cache_entry) + FileSize;
+
+    return InsertCacheEntry(Entry);
+}
+
+size_t FindInjectionOffset(const char *Content, size_t ContentSize)
+{
+    const char *SentinelPosition = (const char *)memmem(Content, ContentSize, Sentinel, strlen(Sentinel));
+    if (SentinelPosition == NULL)
+    {
+        printf("Konnte %s nicht finden!\n", Sentinel);
+        return NoInjectionOffset;
     }
 
-    assert(Position == BufferSize);
+    return (SentinelPosition - Content) + strlen(Sentinel);
 }
 
-void GetContentFilePath(const char *Filename, char Output[PATH_MAX])
+// Wird pro Dateistand nur einmal gesucht
+size_t GetInjectionOffset(cache_entry *Entry)
 {
-    assert(ContentDir != NULL);
-    snprintf(Output, PATH_MAX, "%s/%s", ContentDir, Filename);
+    cache_shard *Shard = GetCacheShard(Entry->Hash);
+
+    pthread_mutex_lock(&Shard->Mutex);
+    size_t InjectionOffset = Entry->InjectionOffset;
+    pthread_mutex_unlock(&Shard->Mutex);
+
+    if (InjectionOffset == UnknownInjectionOffset)
+    {
+        InjectionOffset = FindInjectionOffset(Entry->Content, Entry->FileVersion.Size);
+
+        pthread_mutex_lock(&Shard->Mutex);
+        Entry->InjectionOffset = InjectionOffset;
+        pthread_mutex_unlock(&Shard->Mutex);
+    }
+
+    return InjectionOffset;
 }
 
-char *ReadEntireContentFile(const char *Filename, size_t *Size)
+void CacheReleaseFile(cache_entry *Entry)
 {
-    char Path[PATH_MAX];
-    GetContentFilePath(Filename, Path);
-    return ReadEntireFile(Path, Size);
+    cache_shard *Shard = GetCacheShard(Entry->Hash);
+
+    pthread_mutex_lock(&Shard->Mutex);
+    bool ShouldFree = --Entry->RefCount == 0;
+    pthread_mutex_unlock(&Shard->Mutex);
+
+    if (ShouldFree) FreeCacheEntry(Entry);
 }
 
-char *ReadEntireFile(const char *Path, size_t *Size)
+const size_t MinCompressedFileSize = 256;  // Darunter lohnt sich gzip nicht, der Header frisst den Gewinn
+const int    CompressionLevel      = 9;    // Wird pro Dateistand nur einmal bezahlt
+
+// Komprimiert die Datei (bei InjectScript mit eingefügtem Skript, also genau den ausgelieferten Inhalt)
+// und cacht das Ergebnis neben der Datei selbst. Referenz wie bei CacheAcquireFile(), NULL wenn die
+// Datei nicht gecacht werden kann.
+cache_entry *CacheAcquireCompressed(const char *Path, file_version FileVersion, content_encoding Encoding, bool InjectScript)
 {
-    FILE *File = fopen(Path, "r");
-    if (File == NULL)
+    if (CacheBudget == 0)
+    {
+        return NULL;
+    }
+
+    cache_entry *Found = CacheFindFile(FileVersion, Encoding);
+    if (Found != NULL)
+    {
+        return Found;
+    }
+
+    cache_entry *Source = CacheAcquireFile(Path, FileVersion);
+    if (Source == NULL)
     {
-        PrintError("ReadEntireFile: Konnte %s nicht öffnen", Path);
         return NULL;
     }
 
-    fseek(File, 0, SEEK_END);
-    size_t FileSize = ftell(File);
-    fseek(File, 0, SEEK_SET);
+    defer { CacheReleaseFile(Source); };
 
-    char *Buffer = (char *)malloc(FileSize);
-    size_t FileBytesRead = fread(Buffer, 1, FileSize, File);
-    if (FileBytesRead != FileSize)
+    iovec Parts[3] = { { Source->Content, Source->ContentSize } };
+    int NumParts = 1;
+    size_t InjectionOffset = InjectScript ? GetInjectionOffset(Source) : NoInjectionOffset;
+    if (InjectionOffset != NoInjectionOffset)
     {
-        // TODO Loop
-        PrintError("ReadEntireFile: Es wurde nicht die ganze Datei gelesen...!?");
-        free(Buffer);
-        Buffer = NULL;
+        Parts[0] = { Source->Content, InjectionOffset };
+        Parts[1] = { ClientScriptTag.Data, ClientScriptTag.Size };
+        Parts[2] = { Source->Content + InjectionOffset, Source->ContentSize - InjectionOffset };
+        NumParts = 3;
     }
-    else if (Size != NULL)
+
+    // windowBits + 16 schreibt einen gzip-Rahmen, sonst zlib (HTTP "deflate" meint RFC 1950)
+    z_stream Stream = {};
+    int WindowBits = Encoding == EncodingGzip ? 15 + 16 : 15;
+    if (deflateInit2(&Stream, CompressionLevel, Z_DEFLATED, WindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
     {
-        *Size = FileSize;
+        PrintError("CacheAcquireCompressed: deflateInit2() fehlgeschlagen");
+        return NULL;
     }
 
-    fclose(File);
+    defer { deflateEnd(&Stream); };
 
-    return Buffer;
+    size_t InputSize = 0;
+    for (int I = 0; I < NumParts; ++I) InputSize += Parts[I].iov_len;
+
+    // deflateBound() reicht für einen einzigen deflate()-Aufruf mit Z_FINISH
+    size_t Capacity = deflateBound(&Stream, InputSize);
+    char *Compressed = (char *)malloc(Capacity);
+    Stream.next_out  = (Bytef *)Compressed;
+    Stream.avail_out = Capacity;
+
+    for (int I = 0; I < NumParts; ++I)
+    {
+        Stream.next_in  = (Bytef *)Parts[I].iov_base;
+        Stream.avail_in = Parts[I].iov_len;
+        int Result = deflate(&Stream, I == NumParts - 1 ? Z_FINISH : Z_NO_FLUSH);
+        if (Result != (I == NumParts - 1 ? Z_STREAM_END : Z_OK))
+        {
+            PrintError("CacheAcquireCompressed: Konnte %s nicht komprimieren", Path);
+            free(Compressed);
+            return NULL;
+        }
+    }
+
+    // deflateBound() ist grob die Eingabegröße, gecacht und berechnet wird nur, was wirklich belegt ist
+    char *Shrunk = (char *)realloc(Compressed, Stream.total_out);
+    if (Shrunk != NULL) Compressed = Shrunk;
+
+    cache_entry *Entry = (cache_entry *)calloc(1, sizeof(cache_entry));
+    Entry->Kind            = CacheEntryFile;
+    Entry->FileVersion     = Source->FileVersion;
+    Entry->Encoding        = Encoding;
+    Entry->Hash            = HashFileKey(Entry->FileVersion, Encoding);
+    Entry->RefCount        = 2;  // Cache + Aufrufer
+    Entry->Content         = Compressed;
+    Entry->ContentSize     = Stream.total_out;
+    Entry->InjectionOffset = NoInjectionOffset;
+    Entry->Cost            = sizeof(cache_entry) + Stream.total_out;
+
+    return InsertCacheEntry(Entry);
+}
+
+// Vom Watcher für jede Datei bei jedem Durchlauf aufgerufen
+void CacheCheckFile(const struct stat *Stat)
+{
+    if (CacheBudget == 0)
+    {
+        return;
+    }
+
+    file_version FileVersion = GetFileVersion(Stat);
+    content_encoding Encodings[] = { EncodingIdentity, EncodingGzip, EncodingDeflate };
+    for (content_encoding Encoding : Encodings)
+    {
+        uint64_t Hash = HashFileKey(FileVersion, Encoding);
+        cache_shard *Shard = GetCacheShard(Hash);
+        cache_entry *Changed = NULL;
+
+        pthread_mutex_lock(&Shard->Mutex);
+        cache_entry *Entry = FindFileEntryLocked(Shard, Hash, FileVersion, Encoding);
+        if (Entry != NULL && !IsSameFileVersion(Entry->FileVersion, FileVersion))
+        {
+            if (RemoveCacheEntryLocked(Shard, Entry)) Changed = Entry;
+        }
+        pthread_mutex_unlock(&Shard->Mutex);
+
+        if (Changed != NULL) FreeCacheEntry(Changed);
+    }
 }
 
 //
-// Anfragen-Bearbeitung
+// Build-Jobs
 //
 
-enum ResolveRequestFilePathResult { RequestedFileNotFound, RequestedFileFound, RedirectToDirectory };
-ResolveRequestFilePathResult ResolveRequestFilePath(const char RequestPath[PATH_MAX], char Output[PATH_MAX])
+// Build-Schritte wie tsc laufen als Kindprozesse im Hintergrund, statt den Watcher per system() zu
+// blockieren. Ein eigener Thread wartet per epoll auf die Ausgabe (eine Pipe für stdout und stderr)
+// und auf das Ende (pidfd) der Prozesse. Wird ein Job angefordert, der gerade läuft, ist dessen
+// Ergebnis veraltet: Er wird abgebrochen und neu gestartet. Die Nachrichten an den Client gehen erst
+// raus, wenn ein Lauf fertig ist, der nach ihrer Anforderung gestartet wurde.
+//
+// Daemons sind Jobs, die dauerhaft laufen sollen. Ihre Ausgabe wird zeilenweise an OnOutputLine
+// gegeben, beenden sie sich, werden sie neu gestartet. Sterben sie zu oft direkt nach dem Start,
+// wird aufgegeben und OnFailed aufgerufen.
+
+const int MaxJobs = 8;
+const int MaxQuickDaemonExits  = 3;
+const int QuickDaemonExitMs    = 5000;
+
+typedef void job_output_line_callback(const char *Line, size_t Size);
+typedef void job_failed_callback();
+
+struct job
 {
-    struct stat Stat;
-    char RelativePath[PATH_MAX];
+    char       *Command;  // NULL = Slot frei
+    pid_t       Pid;      // -1 = läuft nicht
+    int         PidFd;
+    int         OutputFd;
+    uint64_t    StartedMs;
+    text_buffer Output;
+    bool        RestartRequested;
+    notification *Notifications;  // Nach dem nächsten fertigen Lauf an die Clients
+    size_t        NumNotifications;
+
+    // Nur für Daemons
+    bool                      IsDaemon;
+    job_output_line_callback *OnOutputLine;
+    job_failed_callback      *OnFailed;
+    int                       NumQuickExits;
+};
+
+struct job_runner
+{
+    pthread_mutex_t Mutex;  // Schützt Command, RestartRequested und Notifications der Jobs
+    int             EpollFd;
+    int             WakeFd;  // eventfd, signalisiert neue Anforderungen
+    bool            IsStopping;  // Daemons nicht mehr neu starten
+    job             Jobs[MaxJobs];
+};
+
+job_runner JobRunner;
 
-    if (strlen(RequestPath) != 0)
+// epoll_event.data.u64: Job-Index * 2 + Art, WakeFd hat einen eigenen Wert
+enum { JobEventPidFd, JobEventOutput };
+const uint64_t JobEventWake = (uint64_t)-1;
+
+bool InitJobRunner()
+{
+    pthread_mutex_init(&JobRunner.Mutex, NULL);
+    for (int I = 0; I < MaxJobs; ++I)
     {
-        strncpy(RelativePath, RequestPath, PATH_MAX);
+        JobRunner.Jobs[I].Pid      = -1;
+        JobRunner.Jobs[I].PidFd    = -1;
+        JobRunner.Jobs[I].OutputFd = -1;
     }
-    else
+
+    JobRunner.EpollFd = epoll_create1(EPOLL_CLOEXEC);
+    JobRunner.WakeFd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (JobRunner.EpollFd == -1 || JobRunner.WakeFd == -1)
     {
-        // Wenn Pfad leer: index.html
-        strncpy(RelativePath, "index.html", PATH_MAX);
+        PrintError("Konnte den Job-Runner nicht initialisieren");
+        return false;
     }
 
-    char ContentFilePath[PATH_MAX];
-    GetContentFilePath(RelativePath, ContentFilePath);
+    epoll_event Event = {};
+    Event.events   = EPOLLIN;
+    Event.data.u64 = JobEventWake;
+    epoll_ctl(JobRunner.EpollFd, EPOLL_CTL_ADD, JobRunner.WakeFd, &Event);
+    return true;
+}
+
+// Fordert einen Lauf von Command an (Thread-sicher). Notification (darf NULL sein) wird verschickt,
+// sobald ein Lauf fertig ist, der nach diesem Aufruf gestartet wurde.
+void SubmitJob(const char *Command, const notification *Notification)
+{
+    pthread_mutex_lock(&JobRunner.Mutex);
+
+    job *Job = NULL;
+    for (int I = 0; I < MaxJobs && Job == NULL; ++I)
+    {
+        if (JobRunner.Jobs[I].Command != NULL && strcmp(JobRunner.Jobs[I].Command, Command) == 0) Job = &JobRunner.Jobs[I];
+    }
+
+    for (int I = 0; I < MaxJobs && Job == NULL; ++I)
+    {
+        if (JobRunner.Jobs[I].Command == NULL)
+        {
+            Job = &JobRunner.Jobs[I];
+            Job->Command = strdup(Command);
+        }
+    }
+
+    if (Job == NULL)
+    {
+        pthread_mutex_unlock(&JobRunner.Mutex);
+        PrintError("Zu viele verschiedene Jobs, '%s' wird nicht ausgeführt", Command);
+        return;
+    }
+
+    Job->RestartRequested = true;
+
+    // Gleiche Nachricht mehrmals hintereinander würde den Client nur mehrmals neu laden
+    bool IsDuplicate = Notification != NULL && Job->NumNotifications > 0 && IsSameNotification(&Job->Notifications[Job->NumNotifications - 1], Notification);
+    if (Notification != NULL && !IsDuplicate)
+    {
+        Job->Notifications = (notification *)realloc(Job->Notifications, (Job->NumNotifications + 1) * sizeof(notification));
+        Job->Notifications[Job->NumNotifications++] = CopyNotification(Notification);
+    }
+
+    pthread_mutex_unlock(&JobRunner.Mutex);
+
+    uint64_t One = 1;
+    write(JobRunner.WakeFd, &One, sizeof(One));
+}
+
+// Startet Command als Daemon (Thread-sicher), siehe oben
+void SubmitDaemon(const char *Command, job_output_line_callback *OnOutputLine, job_failed_callback *OnFailed)
+{
+    pthread_mutex_lock(&JobRunner.Mutex);
+
+    job *Job = NULL;
+    for (int I = 0; I < MaxJobs && Job == NULL; ++I)
+    {
+        if (JobRunner.Jobs[I].Command == NULL) Job = &JobRunner.Jobs[I];
+    }
+
+    if (Job != NULL)
+    {
+        Job->Command          = strdup(Command);
+        Job->IsDaemon         = true;
+        Job->OnOutputLine     = OnOutputLine;
+        Job->OnFailed         = OnFailed;
+        Job->RestartRequested = true;
+    }
+
+    pthread_mutex_unlock(&JobRunner.Mutex);
+
+    if (Job == NULL)
+    {
+        PrintError("Zu viele verschiedene Jobs, '%s' wird nicht ausgeführt", Command);
+        OnFailed();
+        return;
+    }
+
+    uint64_t One = 1;
+    write(JobRunner.WakeFd, &One, sizeof(One));
+}
+
+// Nur auf dem Job-Runner-Thread
+bool StartJob(int JobIndex)
+{
+    job *Job = &JobRunner.Jobs[JobIndex];
+
+    int Pipe[2];
+    if (pipe2(Pipe, O_CLOEXEC) != 0)
+    {
+        PrintError("Konnte keine Pipe für '%s' anlegen", Job->Command);
+        return false;
+    }
+
+    // stdout und stderr in die Pipe, eigene Prozessgruppe zum Abbrechen samt Kindprozessen,
+    // SIGPIPE wieder auf Standard (ignorierte Signale würden sonst vererbt)
+    posix_spawn_file_actions_t FileActions;
+    posix_spawn_file_actions_init(&FileActions);
+    posix_spawn_file_actions_adddup2(&FileActions, Pipe[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&FileActions, Pipe[1], STDERR_FILENO);
+
+    sigset_t DefaultSignals;
+    sigemptyset(&DefaultSignals);
+    sigaddset(&DefaultSignals, SIGPIPE);
+
+    posix_spawnattr_t Attributes;
+    posix_spawnattr_init(&Attributes);
+    posix_spawnattr_setflags(&Attributes, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setpgroup(&Attributes, 0);
+    posix_spawnattr_setsigdefault(&Attributes, &DefaultSignals);
+
+    char *Argv[] = { (char *)"sh", (char *)"-c", Job->Command, NULL };
+    pid_t Pid;
+    int SpawnResult = posix_spawn(&Pid, "/bin/sh", &FileActions, &Attributes, Argv, environ);
+
+    posix_spawn_file_actions_destroy(&FileActions);
+    posix_spawnattr_destroy(&Attributes);
+    close(Pipe[1]);
+
+    if (SpawnResult != 0)
+    {
+        errno = SpawnResult;
+        PrintError("Konnte '%s' nicht starten", Job->Command);
+        close(Pipe[0]);
+        return false;
+    }
+
+    int PidFd = (int)syscall(SYS_pidfd_open, Pid, 0);
+    if (PidFd == -1)
+    {
+        PrintError("pidfd_open für '%s' fehlgeschlagen, warte blockierend", Job->Command);
+        close(Pipe[0]);
+        waitpid(Pid, NULL, 0);
+        return false;
+    }
+
+    fcntl(Pipe[0], F_SETFL, O_NONBLOCK);
+
+    Job->Pid       = Pid;
+    Job->PidFd     = PidFd;
+    Job->OutputFd  = Pipe[0];
+    Job->StartedMs = GetMonotonicMs();
+    Job->Output.Size = 0;
+
+    epoll_event Event = {};
+    Event.events   = EPOLLIN;
+    Event.data.u64 = (uint64_t)JobIndex * 2 + JobEventPidFd;
+    epoll_ctl(JobRunner.EpollFd, EPOLL_CTL_ADD, PidFd, &Event);
+    Event.data.u64 = (uint64_t)JobIndex * 2 + JobEventOutput;
+    epoll_ctl(JobRunner.EpollFd, EPOLL_CTL_ADD, Pipe[0], &Event);
+
+    printf("Job '%s' gestartet (PID %d)\n", Job->Command, (int)Pid);
+    return true;
+}
+
+void ReadJobOutput(job *Job)
+{
+    if (Job->OutputFd == -1)
+    {
+        return;
+    }
+
+    char Buffer[4096];
+    for (;;)
+    {
+        ssize_t BytesRead = read(Job->OutputFd, Buffer, sizeof(Buffer));
+        if (BytesRead == -1 && errno == EINTR) continue;
+        if (BytesRead <= 0)
+        {
+            if (BytesRead == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+                // EOF: Nicht mehr überwachen, geschlossen wird beim Einsammeln des Prozesses
+                epoll_ctl(JobRunner.EpollFd, EPOLL_CTL_DEL, Job->OutputFd, NULL);
+            }
+
+            return;
+        }
+
+        TextAppend(&Job->Output, Buffer, BytesRead);
+        if (Job->OnOutputLine != NULL)
+        {
+            // Vollständige Zeilen weitergeben, den Rest für den nächsten read() aufheben
+            size_t LineStart = 0;
+            for (char *Newline; (Newline = (char *)memchr(Job->Output.Data + LineStart, '\n', Job->Output.Size - LineStart));)
+            {
+                size_t LineEnd = Newline - Job->Output.Data;
+                size_t LineSize = LineEnd - LineStart;
+                if (LineSize > 0 && Job->Output.Data[LineEnd - 1] == '\r') --LineSize;
+
+                Job->OnOutputLine(Job->Output.Data + LineStart, LineSize);
+                LineStart = LineEnd + 1;
+            }
+
+            memmove(Job->Output.Data, Job->Output.Data + LineStart, Job->Output.Size - LineStart);
+            Job->Output.Size -= LineStart;
+            Job->Output.Data[Job->Output.Size] = '\0';
+        }
+    }
+}
+
+// Der Prozess ist beendet: einsammeln und entweder neu starten oder die Nachrichten verschicken
+void FinishJob(int JobIndex)
+{
+    job *Job = &JobRunner.Jobs[JobIndex];
+
+    int Status = 0;
+    waitpid(Job->Pid, &Status, 0);
+    ReadJobOutput(Job);
+
+    epoll_ctl(JobRunner.EpollFd, EPOLL_CTL_DEL, Job->PidFd, NULL);
+    epoll_ctl(JobRunner.EpollFd, EPOLL_CTL_DEL, Job->OutputFd, NULL);
+    close(Job->PidFd);    Job->PidFd = -1;
+    close(Job->OutputFd); Job->OutputFd = -1;
+    Job->Pid = -1;
+
+    if (Job->IsDaemon && !__atomic_load_n(&JobRunner.IsStopping, __ATOMIC_RELAXED))
+    {
+        bool ExitedQuickly = GetMonotonicMs() - Job->StartedMs < (uint64_t)QuickDaemonExitMs;
+        Job->NumQuickExits = ExitedQuickly ? Job->NumQuickExits + 1 : 0;
+        if (Job->NumQuickExits >= MaxQuickDaemonExits)
+        {
+            PrintError("Daemon '%s' beendet sich immer wieder, gebe auf", Job->Command);
+
+            pthread_mutex_lock(&JobRunner.Mutex);
+            free(Job->Command); Job->Command = NULL;
+            Job->IsDaemon         = false;
+            Job->RestartRequested = false;
+            job_failed_callback *OnFailed = Job->OnFailed;
+            Job->OnOutputLine = NULL;
+            Job->OnFailed     = NULL;
+            pthread_mutex_unlock(&JobRunner.Mutex);
+
+            OnFailed();
+            return;
+        }
+
+        printf("Daemon '%s' beendet (Status %d), starte neu\n", Job->Command, Status);
+        StartJob(JobIndex);
+        return;
+    }
+
+    notification *Notifications = NULL;
+    size_t NumNotifications = 0;
+
+    pthread_mutex_lock(&JobRunner.Mutex);
+    bool Restart = Job->RestartRequested;
+    if (Restart)
+    {
+        Job->RestartRequested = false;
+    }
+    else
+    {
+        Notifications    = Job->Notifications;    Job->Notifications = NULL;
+        NumNotifications = Job->NumNotifications; Job->NumNotifications = 0;
+    }
+    pthread_mutex_unlock(&JobRunner.Mutex);
+
+    if (Restart)
+    {
+        printf("Job '%s' abgebrochen, die Eingaben haben sich geändert\n", Job->Command);
+        StartJob(JobIndex);
+        return;
+    }
+
+    if (Job->Output.Size > 0)
+    {
+        printf("%s", Job->Output.Data);
+        if (Job->Output.Data[Job->Output.Size - 1] != '\n') printf("\n");
+    }
+
+    bool Succeeded = WIFEXITED(Status) && WEXITSTATUS(Status) == 0;
+    printf("Job '%s' %s nach %llums\n", Job->Command, Succeeded ? "fertig" : "fehlgeschlagen", (unsigned long long)(GetMonotonicMs() - Job->StartedMs));
+
+    // Auch nach Fehlern, tsc schreibt trotz Typfehlern JavaScript
+    for (size_t I = 0; I < NumNotifications; ++I)
+    {
+        NotifyClients(&Notifications[I]);
+        FreeNotification(&Notifications[I]);
+    }
+
+    free(Notifications);
+}
+
+// Startet angeforderte Jobs bzw. bricht sie ab, wenn sie gerade laufen
+void HandleJobRequests()
+{
+    uint64_t Count;
+    while (read(JobRunner.WakeFd, &Count, sizeof(Count)) > 0) {}
+
+    for (int I = 0; I < MaxJobs; ++I)
+    {
+        job *Job = &JobRunner.Jobs[I];
+
+        pthread_mutex_lock(&JobRunner.Mutex);
+        bool Requested = Job->RestartRequested;
+        if (Requested && Job->Pid == -1) Job->RestartRequested = false;
+        pthread_mutex_unlock(&JobRunner.Mutex);
+
+        if (!Requested)
+        {
+            continue;
+        }
+
+        if (Job->Pid == -1)
+        {
+            StartJob(I);
+        }
+        else
+        {
+            // Neustart, sobald das pidfd das Ende meldet
+            kill(-Job->Pid, SIGTERM);
+        }
+    }
+}
+
+// Die Jobs laufen in eigenen Prozessgruppen und bekommen ein Ctrl+C im Terminal nicht mit.
+// Nur kill(), darf also auch aus dem Signal-Handler aufgerufen werden.
+void KillJobs()
+{
+    __atomic_store_n(&JobRunner.IsStopping, true, __ATOMIC_RELAXED);
+    for (int I = 0; I < MaxJobs; ++I)
+    {
+        pid_t Pid = JobRunner.Jobs[I].Pid;
+        if (Pid != -1) kill(-Pid, SIGTERM);
+    }
+}
+
+void *JobRunnerThreadCallback(void *Arg)
+{
+    bool *IsRunning = (bool *)Arg;
+
+    while (*IsRunning)
+    {
+        epoll_event Events[16];
+        int NumEvents = epoll_wait(JobRunner.EpollFd, Events, ARRAY_LEN(Events), 100);
+        if (NumEvents == -1)
+        {
+            if (errno == EINTR) continue;
+
+            PrintError("Fehler in epoll_wait() im Job-Runner");
+            break;
+        }
+
+        for (int I = 0; I < NumEvents; ++I)
+        {
+            uint64_t Data = Events[I].data.u64;
+            if (Data == JobEventWake)
+            {
+                HandleJobRequests();
+                continue;
+            }
+
+            int JobIndex = (int)(Data / 2);
+            if (JobRunner.Jobs[JobIndex].Pid == -1)
+            {
+                // Schon eingesammelt, Event aus demselben epoll_wait()
+                continue;
+            }
+
+            if (Data % 2 == JobEventOutput) ReadJobOutput(&JobRunner.Jobs[JobIndex]);
+            else                            FinishJob(JobIndex);
+        }
+    }
+
+    // Beim Beenden laufende Jobs nicht verwaisen lassen
+    KillJobs();
+    for (int I = 0; I < MaxJobs; ++I)
+    {
+        if (JobRunner.Jobs[I].Pid != -1) waitpid(JobRunner.Jobs[I].Pid, NULL, 0);
+    }
+
+    return NULL;
+}
+
+//
+// TypeScript-Daemon
+//
+
+// Statt bei jeder Änderung ein frisches tsc zu starten, läuft ein einziges tsc --watch --incremental
+// im Hintergrund. Es beobachtet die .ts-Dateien selbst, der File-Watcher stößt dafür also nichts an.
+// Aus der Ausgabe werden die geschriebenen .js-Dateien (--listEmittedFiles) gesammelt; sobald tsc
+// "Watching for file changes" meldet, ist ein Durchlauf fertig und der Client bekommt genau diese
+// Dateien. Neu geladen werden nur Seiten, die eine davon als Skript einbinden.
+
+const char *const TypescriptDaemonCommand = "tsc --watch --incremental --listEmittedFiles --preserveWatchOutput --pretty false";
+
+bool TypescriptDaemonActive = false;  // Mit __atomic, der Watcher liest mit
+
+struct typescript_compile
+{
+    bool         IsInitial;  // Erster Durchlauf nach dem Start, da ist noch keine Seite veraltet
+    bool         HasWarnedOutside;  // Ausgabe außerhalb von ContentDir nur einmal melden
+    notification EmittedFiles;
+};
+
+typescript_compile TypescriptCompile;  // Nur auf dem Job-Runner-Thread
+
+bool StartsWith(const char *Data, size_t Size, const char *Prefix)
+{
+    size_t PrefixSize = strlen(Prefix);
+    return Size >= PrefixSize && memcmp(Data, Prefix, PrefixSize) == 0;
+}
+
+// Für jede Zeile der tsc-Ausgabe, ohne Zeilenumbruch, auf dem Job-Runner-Thread
+void HandleTypescriptOutputLine(const char *Line, size_t Size)
+{
+    typescript_compile *Compile = &TypescriptCompile;
+
+    const char *EmittedPrefix = "TSFILE: ";
+    if (StartsWith(Line, Size, EmittedPrefix))
+    {
+        str Path = { Line + strlen(EmittedPrefix), Size - strlen(EmittedPrefix) };
+        bool IsJavascript = Path.Size > 3 && memcmp(Path.Data + Path.Size - 3, ".js", 3) == 0;
+        if (!IsJavascript)
+        {
+            return;
+        }
+
+        // ContentDir ist kanonisch (siehe OpenContentDir()), die Datei muss es also auch sein,
+        // sonst passt z.B. ein per Symlink eingebundenes Inhalts-Verzeichnis nie
+        char EmittedPath[PATH_MAX];
+        snprintf(EmittedPath, sizeof(EmittedPath), "%.*s", (int)Path.Size, Path.Data);
+
+        char CanonicalPath[PATH_MAX];
+        if (realpath(EmittedPath, CanonicalPath) == NULL)
+        {
+            strncpy(CanonicalPath, EmittedPath, sizeof(CanonicalPath));
+        }
+
+        size_t ContentDirSize = strlen(ContentDir);
+        bool IsServed = strncmp(CanonicalPath, ContentDir, ContentDirSize) == 0 && CanonicalPath[ContentDirSize] == '/';
+        if (!IsServed)
+        {
+            if (!Compile->HasWarnedOutside)
+            {
+                PrintError("tsc schreibt '%s' außerhalb von '%s', outDir in tsconfig.json prüfen. Für diese Dateien gibt es kein Live-Reload",
+                           CanonicalPath, ContentDir);
+                Compile->HasWarnedOutside = true;
+            }
+
+            return;
+        }
+
+        const char *RelativePath = CanonicalPath + ContentDirSize;
+
+        Compile->EmittedFiles.Type = "reload";
+        AddNotificationPath(&Compile->EmittedFiles, RelativePath);
+        return;
+    }
+
+    printf("tsc: %.*s\n", (int)Size, Line);
+
+    if (memmem(Line, Size, "Starting compilation in watch mode", strlen("Starting compilation in watch mode")) != NULL)
+    {
+        Compile->IsInitial = true;
+    }
+    else if (memmem(Line, Size, "Watching for file changes", strlen("Watching for file changes")) != NULL)
+    {
+        if (Compile->EmittedFiles.NumPaths > 0 && !Compile->IsInitial)
+        {
+            NotifyClients(&Compile->EmittedFiles);
+        }
+
+        Compile->IsInitial = false;
+        FreeNotification(&Compile->EmittedFiles);
+    }
+}
+
+// Wird aufgerufen, wenn der Daemon endgültig aufgegeben wurde
+void HandleTypescriptDaemonFailed()
+{
+    __atomic_store_n(&TypescriptDaemonActive, false, __ATOMIC_RELAXED);
+    PrintError("tsc --watch läuft nicht, kompiliere stattdessen bei jeder Änderung einmal komplett");
+}
+
+void StartTypescriptDaemon()
+{
+    if (access("tsconfig.json", F_OK) != 0)
+    {
+        // Ohne Projekt startet tsc --watch nicht, tsc ohne Argumente scheitert dann aber genauso
+        return;
+    }
+
+    __atomic_store_n(&TypescriptDaemonActive, true, __ATOMIC_RELAXED);
+    SubmitDaemon(TypescriptDaemonCommand, HandleTypescriptOutputLine, HandleTypescriptDaemonFailed);
+}
+
+//
+// FileWatcher
+//
+
+// Die Pfade der Einträge liegen hintereinander in großen Blöcken statt einzeln auf dem Heap.
+// Pfade gelöschter Dateien bleiben liegen, bis sich das Kompaktieren lohnt.
+struct path_arena_block
+{
+    path_arena_block *Next;
+    size_t            Used;
+    size_t            Capacity;
+    char             *Data;  // Direkt hinter dem Block-Header
+};
+
+struct path_arena
+{
+    path_arena_block *First;
+    size_t            LiveBytes;
+    size_t            DeadBytes;
+};
+
+const size_t PathArenaBlockSize = 64 * 1024;
+
+const char *ArenaInternPath(path_arena *Arena, const char *Path)
+{
+    size_t Size = strlen(Path) + 1;
+    path_arena_block *Block = Arena->First;
+    if (Block == NULL || Block->Capacity - Block->Used < Size)
+    {
+        size_t Capacity = Size > PathArenaBlockSize ? Size : PathArenaBlockSize;
+        Block = (path_arena_block *)malloc(sizeof(path_arena_block) + Capacity);
+        Block->Next     = Arena->First;
+        Block->Used     = 0;
+        Block->Capacity = Capacity;
+        Block->Data     = (char *)(Block + 1);
+        Arena->First    = Block;
+    }
+
+    char *Result = Block->Data + Block->Used;
+    memcpy(Result, Path, Size);
+    Block->Used      += Size;
+    Arena->LiveBytes += Size;
+    return Result;
+}
+
+void FreePathArena(path_arena *Arena)
+{
+    for (path_arena_block *Block = Arena->First, *Next; Block != NULL; Block = Next)
+    {
+        Next = Block->Next;
+        free(Block);
+    }
+
+    *Arena = {};
+}
+
+// Open Addressing mit Linear Probing über den Hash des Pfads. Path == NULL markiert einen freien Slot.
+struct file_watcher_entry
+{
+    uint64_t     Hash;
+    const char  *Path;  // In file_watcher::Paths
+    file_version FileVersion;
+    uint64_t     ContentHash;
+    uint32_t     LastSeenScan;
+    uint32_t     QueuedInBatch;  // Siehe QueueChange()
+    uint64_t     DeletedMs;      // 0 = Datei existiert, sonst Grabstein, siehe BuryWatcherEntry()
+};
+
+const size_t   MinWatcherEntriesCapacity = 256;        // Zweierpotenz
+const uint64_t TombstoneLifetimeMs       = 60 * 1000;  // So lange wird eine gelöschte Datei wiedererkannt
+
+// Ein per inotify beobachtetes Verzeichnis. Depth wie in WatcherWalkDir(), ContentDir hat Tiefe 0.
+struct watched_dir
+{
+    char *Path;  // NULL = Slot frei
+    int   Depth;
+};
+
+struct change_batch
+{
+    path_arena   Paths;
+    const char **ChangedPaths;  // Relativ zu ContentDir, in Paths
+    size_t       NumChangedPaths;
+    size_t       ChangedPathsCapacity;
+    bool         NeedsTypescript;
+    bool         ReloadAll;
+    uint64_t     FirstChangeMs;
+    uint64_t     LastChangeMs;
+};
+
+struct file_watcher
+{
+    file_watcher_entry *Entries;
+    size_t              EntriesCapacity;
+    size_t              NumEntries;
+    path_arena          Paths;
+    uint32_t            ScanCount;  // Vollständige Scans, siehe RemoveUnseenWatcherEntries()
+    size_t              NumTombstones;
+    uint64_t            NextTombstonePurgeMs;
+
+    change_batch Batch;
+    uint32_t     BatchCount;  // Nummer des offenen Batches, beginnt bei 1
+
+    // Wiederverwendeter Buffer für HashFileContent()
+    char  *ContentBuffer;
+    size_t ContentBufferCapacity;
+
+    // Nur für das inotify-Backend, InotifyFd == -1 beim Polling
+    int          InotifyFd;
+    watched_dir *WatchedDirs;  // Index = Watch-Deskriptor
+    int          WatchedDirsCapacity;
+};
+
+// NULL, wenn der Name keine Endung hat (z.B. "LICENSE"), deshalb für Vergleiche die Is*Path()-Funktionen
+const char *GetFilenameExtension(const char *Filename)
+{
+    return strrchr(Filename, '.');
+}
+
+bool IsCssPath(const char *Path)
+{
+    const char *Extension = GetFilenameExtension(Path);
+    return Extension != NULL && strcmp(Extension, ".css") == 0;
+}
+
+bool IsHtmlPath(const char *Path)
+{
+    const char *Extension = GetFilenameExtension(Path);
+    return Extension != NULL && strcmp(Extension, ".html") == 0;
+}
+
+bool IsTypescriptPath(const char *Path)
+{
+    const char *Extension = GetFilenameExtension(Path);
+    return Extension != NULL && strcmp(Extension, ".ts") == 0;
+}
+
+bool IsInterestingForWatcher(const char *Filename)
+{
+    const char *FilenameExtension = GetFilenameExtension(Filename);
+    if (FilenameExtension == NULL)
+    {
+        return false;
+    }
+
+    for (size_t I = 0; I < ARRAY_LEN(InterestingFileExtensions); ++I)
+    {
+        const char *InterestingExtension = InterestingFileExtensions[I];
+        if (strcmp(FilenameExtension, InterestingExtension) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//
+// Einträge
+//
+
+file_watcher_entry *FindWatcherEntry(file_watcher *Watcher, const char *Path, uint64_t Hash)
+{
+    size_t Mask = Watcher->EntriesCapacity - 1;
+    for (size_t Slot = Hash & Mask;; Slot = (Slot + 1) & Mask)
+    {
+        file_watcher_entry *Entry = &Watcher->Entries[Slot];
+        if (Entry->Path == NULL)
+        {
+            return NULL;
+        }
+
+        if (Entry->Hash == Hash && strcmp(Entry->Path, Path) == 0)
+        {
+            return Entry;
+        }
+    }
+}
+
+// Path muss schon in Watcher->Paths liegen
+file_watcher_entry *InsertWatcherEntry(file_watcher *Watcher, file_watcher_entry NewEntry)
+{
+    size_t Mask = Watcher->EntriesCapacity - 1;
+    size_t Slot = NewEntry.Hash & Mask;
+    while (Watcher->Entries[Slot].Path != NULL)
+    {
+        Slot = (Slot + 1) & Mask;
+    }
+
+    Watcher->Entries[Slot] = NewEntry;
+    ++Watcher->NumEntries;
+    return &Watcher->Entries[Slot];
+}
+
+// Baut die Tabelle mit neuer Kapazität auf. Mit CompactPaths werden dabei auch die Pfade in eine
+// frische Arena kopiert, damit Pfade gelöschter Dateien keinen Speicher mehr belegen.
+void RebuildWatcherEntries(file_watcher *Watcher, size_t NewCapacity, bool CompactPaths)
+{
+    file_watcher_entry *OldEntries = Watcher->Entries;
+    size_t OldCapacity = Watcher->EntriesCapacity;
+    path_arena OldPaths = Watcher->Paths;
+
+    Watcher->Entries         = (file_watcher_entry *)calloc(NewCapacity, sizeof(file_watcher_entry));
+    Watcher->EntriesCapacity = NewCapacity;
+    Watcher->NumEntries      = 0;
+    if (CompactPaths) Watcher->Paths = {};
+
+    for (size_t I = 0; I < OldCapacity; ++I)
+    {
+        file_watcher_entry Entry = OldEntries[I];
+        if (Entry.Path == NULL) continue;
+
+        if (CompactPaths) Entry.Path = ArenaInternPath(&Watcher->Paths, Entry.Path);
+        InsertWatcherEntry(Watcher, Entry);
+    }
+
+    free(OldEntries);
+    if (CompactPaths) FreePathArena(&OldPaths);
+}
+
+file_watcher_entry *AddWatcherEntry(file_watcher *Watcher, const char *Path, uint64_t Hash)
+{
+    // Höchstens halb voll, damit die Probing-Ketten kurz bleiben
+    if ((Watcher->NumEntries + 1) * 2 > Watcher->EntriesCapacity)
+    {
+        RebuildWatcherEntries(Watcher, Watcher->EntriesCapacity * 2, false);
+    }
+
+    file_watcher_entry NewEntry = {};
+    NewEntry.Hash = Hash;
+    NewEntry.Path = ArenaInternPath(&Watcher->Paths, Path);
+    return InsertWatcherEntry(Watcher, NewEntry);
+}
+
+// Entfernt den Eintrag ohne Grabstein: Nachfolgende Einträge derselben Probing-Kette rücken auf.
+// Danach steht in Slot evtl. ein noch nicht besuchter Eintrag, beim Iterieren also Slot erneut prüfen.
+void RemoveWatcherEntryAt(file_watcher *Watcher, size_t Slot)
+{
+    size_t Mask = Watcher->EntriesCapacity - 1;
+    size_t PathSize = strlen(Watcher->Entries[Slot].Path) + 1;
+    Watcher->Paths.LiveBytes -= PathSize;
+    Watcher->Paths.DeadBytes += PathSize;
+
+    size_t Hole = Slot;
+    for (size_t Next = (Hole + 1) & Mask; Watcher->Entries[Next].Path != NULL; Next = (Next + 1) & Mask)
+    {
+        // Darf nur aufrücken, wenn das Loch zwischen seinem Heimat-Slot und seiner Position liegt
+        size_t Home = Watcher->Entries[Next].Hash & Mask;
+        bool CanMove = ((Next - Home) & Mask) >= ((Next - Hole) & Mask);
+        if (CanMove)
+        {
+            Watcher->Entries[Hole] = Watcher->Entries[Next];
+            Hole = Next;
+        }
+    }
+
+    Watcher->Entries[Hole] = {};
+    --Watcher->NumEntries;
+}
+
+// Nach dem Entfernen aufrufen, schrumpft Tabelle und Arena, sobald überwiegend Luft drin ist
+void ShrinkWatcherEntries(file_watcher *Watcher)
+{
+    size_t NewCapacity = Watcher->EntriesCapacity;
+    while (NewCapacity > MinWatcherEntriesCapacity && Watcher->NumEntries * 8 < NewCapacity)
+    {
+        NewCapacity /= 2;
+    }
+
+    bool CompactPaths = Watcher->Paths.DeadBytes > PathArenaBlockSize && Watcher->Paths.DeadBytes > Watcher->Paths.LiveBytes;
+    if (NewCapacity != Watcher->EntriesCapacity || CompactPaths)
+    {
+        RebuildWatcherEntries(Watcher, NewCapacity, CompactPaths);
+    }
+}
+
+// Gelöschte Dateien bleiben eine Weile als Grabstein mit ihrem letzten Inhalts-Hash stehen. Editoren
+// wie vim benennen beim Speichern das Original um und schreiben eine neue Datei, git löscht und legt
+// neu an: Taucht die Datei wieder auf, wird sie wie eine Änderung über den Hash verglichen.
+void BuryWatcherEntry(file_watcher *Watcher, file_watcher_entry *Entry)
+{
+    if (Entry->DeletedMs != 0)
+    {
+        return;
+    }
+
+    printf("Datei %s gelöscht!\n", Entry->Path);
+
+    uint64_t Now = GetMonotonicMs();
+    if (Watcher->NumTombstones++ == 0) Watcher->NextTombstonePurgeMs = Now + TombstoneLifetimeMs;
+
+    Entry->FileVersion = {};
+    Entry->DeletedMs   = Now;
+}
+
+// Markiert die Einträge für das Verzeichnis Path und alles darunter als gelöscht
+void RemoveWatcherEntries(file_watcher *Watcher, const char *Path)
+{
+    size_t PathSize = strlen(Path);
+    for (size_t Slot = 0; Slot < Watcher->EntriesCapacity; ++Slot)
+    {
+        const char *EntryPath = Watcher->Entries[Slot].Path;
+        if (EntryPath != NULL && strncmp(EntryPath, Path, PathSize) == 0 && (EntryPath[PathSize] == '\0' || EntryPath[PathSize] == '/'))
+        {
+            BuryWatcherEntry(Watcher, &Watcher->Entries[Slot]);
+        }
+    }
+}
+
+// Markiert nach einem vollständigen Scan alle Einträge als gelöscht, deren Datei dabei nicht mehr gefunden wurde
+void RemoveUnseenWatcherEntries(file_watcher *Watcher)
+{
+    for (size_t Slot = 0; Slot < Watcher->EntriesCapacity; ++Slot)
+    {
+        file_watcher_entry *Entry = &Watcher->Entries[Slot];
+        if (Entry->Path != NULL && Entry->LastSeenScan != Watcher->ScanCount)
+        {
+            BuryWatcherEntry(Watcher, Entry);
+        }
+    }
+}
+
+// Entfernt abgelaufene Grabsteine endgültig
+void PurgeWatcherTombstones(file_watcher *Watcher, uint64_t Now)
+{
+    if (Watcher->NumTombstones == 0 || Now < Watcher->NextTombstonePurgeMs)
+    {
+        return;
+    }
+
+    for (size_t Slot = 0; Slot < Watcher->EntriesCapacity;)
+    {
+        file_watcher_entry *Entry = &Watcher->Entries[Slot];
+        if (Entry->Path != NULL && Entry->DeletedMs != 0 && Now - Entry->DeletedMs >= TombstoneLifetimeMs)
+        {
+            RemoveWatcherEntryAt(Watcher, Slot);
+            --Watcher->NumTombstones;
+            continue;
+        }
+
+        ++Slot;
+    }
+
+    // Die übrigen laufen spätestens nach einer weiteren Lebensdauer ab
+    Watcher->NextTombstonePurgeMs = Now + TombstoneLifetimeMs;
+    ShrinkWatcherEntries(Watcher);
+}
+
+//
+// Änderungs-Batches
+//
+
+// Ein git checkout oder ein Formatter ändert viele Dateien auf einmal. Statt für jede Datei zu
+// kompilieren und neu zu laden, werden Änderungen gesammelt, bis DebounceMs lang Ruhe ist (bei
+// Dauerfeuer spätestens nach MaxBatchDelayFactor * DebounceMs), und dann gemeinsam gemeldet.
+
+const int MaxBatchDelayFactor = 10;
+
+void QueueChange(file_watcher *Watcher, file_watcher_entry *Entry, const char *RelativePath)
+{
+    bool IsTypescript = IsTypescriptPath(RelativePath);
+    if (IsTypescript && __atomic_load_n(&TypescriptDaemonActive, __ATOMIC_RELAXED))
+    {
+        // tsc --watch hat die Änderung selbst gesehen und meldet die geschriebenen .js-Dateien
+        return;
+    }
+
+    change_batch *Batch = &Watcher->Batch;
+    uint64_t Now = GetMonotonicMs();
+    if (Batch->NumChangedPaths == 0)
+    {
+        Batch->FirstChangeMs = Now;
+    }
+
+    Batch->LastChangeMs = Now;
+
+    if (Entry->QueuedInBatch == Watcher->BatchCount)
+    {
+        return;
+    }
+
+    Entry->QueuedInBatch = Watcher->BatchCount;
+
+    if (Batch->NumChangedPaths == Batch->ChangedPathsCapacity)
+    {
+        Batch->ChangedPathsCapacity = Batch->ChangedPathsCapacity == 0 ? 64 : Batch->ChangedPathsCapacity * 2;
+        Batch->ChangedPaths = (const char **)realloc(Batch->ChangedPaths, Batch->ChangedPathsCapacity * sizeof(const char *));
+    }
+
+    Batch->ChangedPaths[Batch->NumChangedPaths++] = ArenaInternPath(&Batch->Paths, RelativePath);
+
+    if (IsTypescript)
+    {
+        Batch->NeedsTypescript = true;
+        Batch->ReloadAll       = true;
+    }
+}
+
+bool ShouldFlushChangeBatch(file_watcher *Watcher, uint64_t Now)
+{
+    change_batch *Batch = &Watcher->Batch;
+    return Batch->NumChangedPaths != 0 &&
+           (Now - Batch->LastChangeMs >= (uint64_t)DebounceMs || Now - Batch->FirstChangeMs >= (uint64_t)DebounceMs * MaxBatchDelayFactor);
+}
+
+// Millisekunden, bis ShouldFlushChangeBatch() true wird, -1 ohne offene Änderungen
+int GetChangeBatchTimeout(file_watcher *Watcher, uint64_t Now)
+{
+    change_batch *Batch = &Watcher->Batch;
+    if (Batch->NumChangedPaths == 0)
+    {
+        return -1;
+    }
+
+    uint64_t Deadline = Batch->LastChangeMs + DebounceMs;
+    uint64_t MaxDeadline = Batch->FirstChangeMs + (uint64_t)DebounceMs * MaxBatchDelayFactor;
+    if (MaxDeadline < Deadline) Deadline = MaxDeadline;
+    return Deadline <= Now ? 0 : (int)(Deadline - Now);
+}
+
+// Stößt höchstens einen Build an und benachrichtigt die Clients mit höchstens zwei Nachrichten:
+// * {"type":"css","paths":["/a.css"]} sofort, die Seiten tauschen nur die Stylesheets aus
+// * {"type":"reload","paths":["/a.html","/b.html"]}, bei einem Build erst danach. "*" lädt jede Seite neu.
+void FlushChangeBatch(file_watcher *Watcher)
+{
+    change_batch *Batch = &Watcher->Batch;
+    if (Batch->NumChangedPaths == 0)
+    {
+        return;
+    }
+
+    printf("%zu geänderte Datei(en)\n", Batch->NumChangedPaths);
+
+    notification CssChanges    = { "css", {}, 0 };
+    notification ReloadChanges = { "reload", {}, 0 };
+    for (size_t I = 0; I < Batch->NumChangedPaths; ++I)
+    {
+        const char *Path = Batch->ChangedPaths[I];
+        AddNotificationPath(IsCssPath(Path) ? &CssChanges : &ReloadChanges, Path);
+    }
+
+    if (Batch->ReloadAll) AddNotificationPath(&ReloadChanges, "*");
+
+    if (CssChanges.NumPaths > 0)
+    {
+        NotifyClients(&CssChanges);
+    }
+
+    if (Batch->NeedsTypescript)
+    {
+        SubmitJob("tsc", &ReloadChanges);
+    }
+    else if (ReloadChanges.NumPaths > 0)
+    {
+        NotifyClients(&ReloadChanges);
+    }
+
+    FreeNotification(&CssChanges);
+    FreeNotification(&ReloadChanges);
+
+    FreePathArena(&Batch->Paths);
+    Batch->NumChangedPaths = 0;
+    Batch->NeedsTypescript = false;
+    Batch->ReloadAll       = false;
+    ++Watcher->BatchCount;
+}
+
+bool IsWatchedDepth(int Depth)
+{
+    return MaxDepth == -1 || Depth <= MaxDepth;
+}
+
+// Liest die Datei komplett und hasht den Inhalt. Kein mmap(), die Datei könnte währenddessen von
+// einem Editor gekürzt werden. false, wenn die Datei nicht (mehr) gelesen werden kann.
+bool HashFileContent(file_watcher *Watcher, const char *RelativePath, uint64_t *ContentHash)
+{
+    int Fd = OpenContentFile(RelativePath, O_RDONLY);
+    if (Fd == -1)
+    {
+        return false;
+    }
+
+    defer { close(Fd); Fd = -1; };
+
+    size_t Size = 0;
+    for (;;)
+    {
+        if (Size == Watcher->ContentBufferCapacity)
+        {
+            Watcher->ContentBufferCapacity = Size == 0 ? 64 * 1024 : Size * 2;
+            Watcher->ContentBuffer = (char *)realloc(Watcher->ContentBuffer, Watcher->ContentBufferCapacity);
+        }
+
+        ssize_t BytesRead = read(Fd, Watcher->ContentBuffer + Size, Watcher->ContentBufferCapacity - Size);
+        if (BytesRead == -1 && errno == EINTR) continue;
+        if (BytesRead == -1) return false;
+        if (BytesRead == 0) break;
+
+        Size += BytesRead;
+    }
+
+    *ContentHash = HashXx64(Watcher->ContentBuffer, Size);
+    return true;
+}
+
+// Für jede gefundene Datei aufgerufen, die neu ist oder sich geändert haben könnte. Neu geladen wird
+// nur, wenn sich die Bytes wirklich geändert haben: Erst billig über mtime (ns) und Größe, dann über
+// den Hash des Inhalts. touch, chmod oder erneutes Speichern ohne Änderung lösen nichts aus.
+void WatcherCheckFile(file_watcher *Watcher, const char *Path, const struct stat *Stat)
+{
+    CacheCheckFile(Stat);
+
+    const char *Filename = strrchr(Path, '/') + 1;
+    const char *RelativePath = Path + strlen(ContentDir);
+    if (!IsInterestingForWatcher(Filename))
+    {
+        return;
+    }
+
+    file_version FileVersion = GetFileVersion(Stat);
+    uint64_t Hash = HashBytes(Path, strlen(Path));
+    file_watcher_entry *FoundEntry = FindWatcherEntry(Watcher, Path, Hash);
+    if (FoundEntry != NULL)
+    {
+        FoundEntry->LastSeenScan = Watcher->ScanCount;
+        if (IsSameFileVersion(FoundEntry->FileVersion, FileVersion))
+        {
+            return;
+        }
+
+        uint64_t ContentHash;
+        if (!HashFileContent(Watcher, RelativePath, &ContentHash))
+        {
+            // Gerade gelöscht, das meldet der nächste Event bzw. Scan
+            return;
+        }
+
+        if (FoundEntry->DeletedMs != 0)
+        {
+            printf("Datei %s wieder angelegt!\n", RelativePath);
+            FoundEntry->DeletedMs = 0;
+            --Watcher->NumTombstones;
+        }
+
+        FoundEntry->FileVersion = FileVersion;
+        bool FileChanged = FoundEntry->ContentHash != ContentHash;
+        if (FileChanged)
+        {
+            printf("Datei %s geändert!\n", RelativePath);
+            FoundEntry->ContentHash = ContentHash;
+            QueueChange(Watcher, FoundEntry, RelativePath);
+        }
+    }
+    else
+    {
+        uint64_t ContentHash;
+        if (!HashFileContent(Watcher, RelativePath, &ContentHash))
+        {
+            return;
+        }
+
+        printf("Neue Datei %s!\n", Path);
+
+        file_watcher_entry *Entry = AddWatcherEntry(Watcher, Path, Hash);
+        Entry->FileVersion  = FileVersion;
+        Entry->ContentHash  = ContentHash;
+        Entry->LastSeenScan = Watcher->ScanCount;
+    }
+}
+
+// Öffnet ein Verzeichnis des Watchers wie alle anderen Zugriffe über ContentDirFd, DirPath beginnt mit ContentDir
+DIR *OpenWatchedDirectory(const char *DirPath)
+{
+    int DirFd = OpenContentFile(DirPath + strlen(ContentDir), O_RDONLY | O_DIRECTORY);
+    if (DirFd == -1)
+    {
+        return NULL;
+    }
+
+    DIR *Dir = fdopendir(DirFd);
+    if (Dir == NULL) close(DirFd);
+    return Dir;
+}
+
+// TreeFingerprint summiert über alle gefundenen Pfade und Dateistände. Ändert sich die Summe zwischen
+// zwei Durchläufen, wurde etwas angelegt, gelöscht, ersetzt oder geändert.
+bool WatcherWalkDir(file_watcher *Watcher, const char *DirPath, uint64_t *TreeFingerprint, int Depth = 0)
+{
+    //for (int I = 0; I < Depth; ++I) printf("....");
+    //printf("Scanne Verzeichnis %s\n", DirPath);
+
+    DIR *Dir = OpenWatchedDirectory(DirPath);
+    if (Dir == NULL && errno == EXDEV)
+    {
+        // Symlink nach außerhalb von ContentDir, wird auch nicht ausgeliefert
+        return true;
+    }
+
+    if (Dir == NULL)
+    {
+        PrintError("Konnte das Verzeichnis '%s' nicht öffnen.", DirPath);
+        return false;
+    }
+
+    defer { closedir(Dir); Dir = NULL; };
+
+
+    for (dirent *Ent; (Ent = readdir(Dir));)
+    {
+        const char *Filename = Ent->d_name;
+        if (strcmp(Filename, ".") == 0 || strcmp(Filename, "..") == 0)
+        {
+            continue;
+        }
+
+        // Ohne realpath(): Filename enthält kein '/', der Pfad bleibt so kanonisch wie DirPath
+        char Path[PATH_MAX];
+        snprintf(Path, sizeof(Path), "%s/%s", DirPath, Filename);
+
+        struct stat Stat;
+        if (fstatat(dirfd(Dir), Filename, &Stat, 0) != 0)
+        {
+            // Zwischen readdir() und stat() gelöscht
+            continue;
+        }
+
+        file_version FileVersion = GetFileVersion(&Stat);
+        *TreeFingerprint += HashBytes(&FileVersion, sizeof(FileVersion), HashBytes(Path, strlen(Path)));
+
+        if (S_ISDIR(Stat.st_mode))
+        {
+            if (IsWatchedDepth(Depth + 1))
+            {
+                WatcherWalkDir(Watcher, Path, TreeFingerprint, Depth + 1);
+            }
+        }
+        else
+        {
+            WatcherCheckFile(Watcher, Path, &Stat);
+        }
+    }
+
+    return true;
+}
+
+// Scannt den gesamten Baum und entfernt danach die Einträge für Dateien, die es nicht mehr gibt
+bool WatcherScanTree(file_watcher *Watcher, uint64_t *TreeFingerprint)
+{
+    ++Watcher->ScanCount;
+    if (!WatcherWalkDir(Watcher, ContentDir, TreeFingerprint))
+    {
+        return false;
+    }
+
+    RemoveUnseenWatcherEntries(Watcher);
+    return true;
+}
+
+//
+// inotify-Backend
+//
+
+// Änderungen melden sich hier innerhalb von Mikrosekunden statt erst beim nächsten Polling-Durchlauf.
+// Jedes Verzeichnis bis MaxDepth bekommt einen eigenen Watch, neue Unterverzeichnisse werden beim
+// Anlegen nachgetragen. Läuft die Event-Queue des Kernels über, wird einmal komplett neu gescannt.
+
+const uint32_t WatcherDirectoryEvents =
+    IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_ONLYDIR;
+
+// Nur diese ändern, welche Pfade es gibt, der Rest betrifft Inhalte
+const uint32_t WatcherTreeEvents = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_Q_OVERFLOW;
+
+// Beobachtet das Verzeichnis und alle Unterverzeichnisse bis MaxDepth. Ein bereits beobachtetes
+// Verzeichnis behält seinen Watch-Deskriptor, erneutes Hinzufügen ist also harmlos.
+// inotify_add_watch() kennt keine Variante mit Verzeichnis-fd, nur dafür wird der volle Pfad benutzt.
+bool WatcherAddDirectory(file_watcher *Watcher, const char *DirPath, int Depth)
+{
+    int Wd = inotify_add_watch(Watcher->InotifyFd, DirPath, WatcherDirectoryEvents);
+    if (Wd == -1)
+    {
+        if (errno == ENOENT || errno == ENOTDIR)
+        {
+            // Schon wieder gelöscht
+            return true;
+        }
+
+        PrintError("Konnte das Verzeichnis '%s' nicht beobachten", DirPath);
+        return false;
+    }
+
+    if (Wd >= Watcher->WatchedDirsCapacity)
+    {
+        int NewCapacity = Watcher->WatchedDirsCapacity * 2;
+        if (NewCapacity <= Wd) NewCapacity = Wd + 64;
+
+        Watcher->WatchedDirs = (watched_dir *)realloc(Watcher->WatchedDirs, NewCapacity * sizeof(watched_dir));
+        memset(Watcher->WatchedDirs + Watcher->WatchedDirsCapacity, 0, (NewCapacity - Watcher->WatchedDirsCapacity) * sizeof(watched_dir));
+        Watcher->WatchedDirsCapacity = NewCapacity;
+    }
+
+    watched_dir *Watched = &Watcher->WatchedDirs[Wd];
+    if (Watched->Path == NULL || strcmp(Watched->Path, DirPath) != 0)
+    {
+        free(Watched->Path);
+        Watched->Path = strdup(DirPath);
+    }
+
+    Watched->Depth = Depth;
+
+    if (!IsWatchedDepth(Depth + 1))
+    {
+        return true;
+    }
+
+    DIR *Dir = OpenWatchedDirectory(DirPath);
+    if (Dir == NULL)
+    {
+        // Zwischen inotify_add_watch() und dem Öffnen gelöscht
+        return true;
+    }
+
+    defer { closedir(Dir); Dir = NULL; };
+
+    for (dirent *Ent; (Ent = readdir(Dir));)
+    {
+        const char *Filename = Ent->d_name;
+        if (strcmp(Filename, ".") == 0 || strcmp(Filename, "..") == 0)
+        {
+            continue;
+        }
+
+        char Path[PATH_MAX];
+        snprintf(Path, sizeof(Path), "%s/%s", DirPath, Filename);
+
+        bool IsDirectory = Ent->d_type == DT_DIR;
+        if (Ent->d_type == DT_UNKNOWN || Ent->d_type == DT_LNK)
+        {
+            struct stat Stat;
+            // Über ContentDirFd, damit kein Watch auf einem Verzeichnis außerhalb landet
+            IsDirectory = StatContentFile(Path + strlen(ContentDir), &Stat) && S_ISDIR(Stat.st_mode);
+        }
+
+        if (IsDirectory && !WatcherAddDirectory(Watcher, Path, Depth + 1))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Entfernt die Watches für das Verzeichnis und alles darunter, z.B. wenn es aus dem Baum verschoben wurde.
+// Die Slots selbst werden erst mit dem IN_IGNORED-Event freigegeben.
+void WatcherRemoveDirectory(file_watcher *Watcher, const char *DirPath)
+{
+    size_t DirPathSize = strlen(DirPath);
+    for (int Wd = 0; Wd < Watcher->WatchedDirsCapacity; ++Wd)
+    {
+        const char *Path = Watcher->WatchedDirs[Wd].Path;
+        if (Path != NULL && strncmp(Path, DirPath, DirPathSize) == 0 && (Path[DirPathSize] == '\0' || Path[DirPathSize] == '/'))
+        {
+            inotify_rm_watch(Watcher->InotifyFd, Wd);
+        }
+    }
+}
+
+bool WatcherHandleEvent(file_watcher *Watcher, const inotify_event *Event)
+{
+    if (Event->mask & IN_Q_OVERFLOW)
+    {
+        printf("inotify-Queue übergelaufen, scanne neu...\n");
+
+        uint64_t TreeFingerprint = 0;
+        return WatcherAddDirectory(Watcher, ContentDir, 0) && WatcherScanTree(Watcher, &TreeFingerprint);
+    }
+
+    if (Event->wd < 0 || Event->wd >= Watcher->WatchedDirsCapacity || Watcher->WatchedDirs[Event->wd].Path == NULL)
+    {
+        return true;
+    }
+
+    watched_dir *Watched = &Watcher->WatchedDirs[Event->wd];
+    if (Event->mask & IN_IGNORED)
+    {
+        free(Watched->Path); Watched->Path = NULL;
+        return true;
+    }
+
+    if (Event->len == 0)
+    {
+        // Betrifft das Verzeichnis selbst, das Event im Elternverzeichnis reicht
+        return true;
+    }
+
+    char Path[PATH_MAX];
+    snprintf(Path, sizeof(Path), "%s/%s", Watched->Path, Event->name);
+
+    if (Event->mask & IN_ISDIR)
+    {
+        if (Event->mask & (IN_DELETE | IN_MOVED_FROM))
+        {
+            WatcherRemoveDirectory(Watcher, Path);
+            RemoveWatcherEntries(Watcher, Path);
+        }
+        else if ((Event->mask & (IN_CREATE | IN_MOVED_TO)) && IsWatchedDepth(Watched->Depth + 1))
+        {
+            // Dateien, die vor dem Watch im neuen Verzeichnis gelandet sind, findet nur ein Scan
+            uint64_t TreeFingerprint = 0;
+            return WatcherAddDirectory(Watcher, Path, Watched->Depth + 1) &&
+                   WatcherWalkDir(Watcher, Path, &TreeFingerprint, Watched->Depth + 1);
+        }
+
+        return true;
+    }
+
+    if (Event->mask & (IN_DELETE | IN_MOVED_FROM))
+    {
+        // Nur die eine Datei, den ganzen Baum durchsuchen muss nur ein Verzeichnis (oben)
+        file_watcher_entry *Entry = FindWatcherEntry(Watcher, Path, HashBytes(Path, strlen(Path)));
+        if (Entry != NULL) BuryWatcherEntry(Watcher, Entry);
+        return true;
+    }
+
+    struct stat Stat;
+    if (!StatContentFile(Path + strlen(ContentDir), &Stat))
+    {
+        // Schon wieder gelöscht
+        return true;
+    }
+
+    if (Event->mask & IN_MODIFY)
+    {
+        // Die Datei wird evtl. noch geschrieben, der Client wird erst bei IN_CLOSE_WRITE benachrichtigt
+        CacheCheckFile(&Stat);
+        return true;
+    }
+
+    WatcherCheckFile(Watcher, Path, &Stat);
+    return true;
+}
+
+// Gibt false zurück, wenn inotify nicht mehr benutzt werden kann
+bool RunInotifyWatcher(file_watcher *Watcher, bool *IsRunning)
+{
+    alignas(inotify_event) char Buffer[64 * 1024];
+
+    while (*IsRunning)
+    {
+        // Mit Timeout, damit IsRunning regelmäßig geprüft wird und offene Batches rausgehen
+        int Timeout = GetChangeBatchTimeout(Watcher, GetMonotonicMs());
+        if (Timeout == -1 || Timeout > 100) Timeout = 100;
+
+        pollfd PollFd = { Watcher->InotifyFd, POLLIN, 0 };
+        int NumReady = poll(&PollFd, 1, Timeout);
+        if (NumReady == -1 && errno != EINTR)
+        {
+            PrintError("Fehler beim Warten auf inotify-Events");
+            return false;
+        }
+
+        if (NumReady <= 0)
+        {
+            PurgeWatcherTombstones(Watcher, GetMonotonicMs());
+            if (ShouldFlushChangeBatch(Watcher, GetMonotonicMs())) FlushChangeBatch(Watcher);
+            continue;
+        }
+
+        bool TreeChanged    = false;
+        bool ContentChanged = false;
+        for (;;)
+        {
+            ssize_t BytesRead = read(Watcher->InotifyFd, Buffer, sizeof(Buffer));
+            if (BytesRead == -1)
+            {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+                PrintError("Fehler beim Lesen der inotify-Events");
+                return false;
+            }
+
+            for (char *At = Buffer; At < Buffer + BytesRead;)
+            {
+                const inotify_event *Event = (const inotify_event *)At;
+                At += sizeof(inotify_event) + Event->len;
+
+                if (Event->mask & WatcherTreeEvents) TreeChanged    = true;
+                else                                 ContentChanged = true;
+
+                if (!WatcherHandleEvent(Watcher, Event))
+                {
+                    return false;
+                }
+            }
+        }
+
+        // Beim Speichern ändert sich nur der Inhalt, dann bleiben die Auflösungen erhalten
+        if (TreeChanged)
+        {
+            CacheInvalidateResolutions();
+        }
+        else if (ContentChanged)
+        {
+            CacheInvalidateFileVersions();
+        }
+
+        PurgeWatcherTombstones(Watcher, GetMonotonicMs());
+        if (ShouldFlushChangeBatch(Watcher, GetMonotonicMs())) FlushChangeBatch(Watcher);
+    }
+
+    return true;
+}
+
+//
+// Polling-Backend
+//
+
+void RunPollingWatcher(file_watcher *Watcher, bool *IsRunning, uint64_t LastTreeFingerprint)
+{
+    while (*IsRunning)
+    {
+        usleep(50 * 1000);
+
+        uint64_t TreeFingerprint = 0;
+        if (!WatcherScanTree(Watcher, &TreeFingerprint))
+        {
+            PrintError("Es gab einen Fehler beim Scannen der Verzeichnisstruktur.");
+            return;
+        }
+
+        if (TreeFingerprint != LastTreeFingerprint)
+        {
+            CacheInvalidateResolutions();
+            LastTreeFingerprint = TreeFingerprint;
+        }
+
+        PurgeWatcherTombstones(Watcher, GetMonotonicMs());
+        if (ShouldFlushChangeBatch(Watcher, GetMonotonicMs())) FlushChangeBatch(Watcher);
+    }
+}
+
+void *FileWatcherThreadCallback(void *Arg)
+{
+    bool *IsRunning = (bool *)Arg;
+
+    file_watcher Watcher = {};
+    Watcher.EntriesCapacity = MinWatcherEntriesCapacity;
+    Watcher.Entries         = (file_watcher_entry *)calloc(Watcher.EntriesCapacity, sizeof(file_watcher_entry));
+    Watcher.InotifyFd       = -1;
+    Watcher.BatchCount      = 1;
+    defer
+    {
+        free(Watcher.Entries); Watcher.Entries = NULL;
+        FreePathArena(&Watcher.Paths);
+        free(Watcher.ContentBuffer); Watcher.ContentBuffer = NULL;
+        FreePathArena(&Watcher.Batch.Paths);
+        free(Watcher.Batch.ChangedPaths); Watcher.Batch.ChangedPaths = NULL;
+
+        for (int I = 0; I < Watcher.WatchedDirsCapacity; ++I) free(Watcher.WatchedDirs[I].Path);
+        free(Watcher.WatchedDirs); Watcher.WatchedDirs = NULL;
+
+        if (Watcher.InotifyFd != -1) close(Watcher.InotifyFd);
+    };
+
+    // Watches vor dem ersten Scan anlegen, damit dazwischen keine Änderung verloren geht
+    if (!UsePollingWatcher)
+    {
+        Watcher.InotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (Watcher.InotifyFd == -1 || !WatcherAddDirectory(&Watcher, ContentDir, 0))
+        {
+            PrintError("inotify ist nicht verfügbar, falle auf Polling zurück");
+            if (Watcher.InotifyFd != -1) close(Watcher.InotifyFd);
+            Watcher.InotifyFd = -1;
+        }
+    }
+
+    uint64_t TreeFingerprint = 0;
+    if (!WatcherScanTree(&Watcher, &TreeFingerprint))
+    {
+        PrintError("Es gab einen Fehler beim Scannen der Verzeichnisstruktur.");
+        return NULL;
+    }
+
+    printf("File-Watcher gestartet (%s).\n", Watcher.InotifyFd != -1 ? "inotify" : "Polling");
+
+    if (Watcher.InotifyFd != -1 && !RunInotifyWatcher(&Watcher, IsRunning))
+    {
+        PrintError("inotify-Watcher abgebrochen, falle auf Polling zurück");
+        close(Watcher.InotifyFd); Watcher.InotifyFd = -1;
+
+        // Was seit dem letzten Event passiert ist, erkennt der erste Polling-Durchlauf
+        TreeFingerprint = 0;
+    }
+
+    if (Watcher.InotifyFd == -1)
+    {
+        RunPollingWatcher(&Watcher, IsRunning, TreeFingerprint);
+    }
+
+    printf("File-Watcher gestoppt.\n");
+
+    return NULL;
+}
+
+//
+// SASS-Watcher
+//
+
+void StartSassWatcher()
+{
+    if (SassWatcherPid != -1)
+    {
+        PrintError("SassWatcher bereits gestartet!");
+        return;
+    }
+
+    if (SassMode == SassDisabled)
+    {
+        return;
+    }
+
+    printf("Starte den SASS-Watcher.\n");
+
+    SassWatcherPid = fork();
+    if (SassWatcherPid == 0)
+    {
+        // Child process
+
+        const char *SassMapFilename = "sass-map.txt";
+        char *SassMap = ReadEntireContentFile(SassMapFilename);
+        if (SassMap == NULL)
+        {
+            SassMap = strdup("scss/:css/");
+            printf("%s nicht gefunden, verwende Fallback-Map '%s'\n", SassMapFilename, SassMap);
+        }
+
+        defer { free(SassMap); SassMap = NULL; };
+
+        if (SassMode == SassDocker)
+        {
+            char Pwd[PATH_MAX];
+            getcwd(Pwd, sizeof(Pwd));
+
+            RunCommand(
+                "docker run --rm -d -it --name %s -v %s:/sass node bash -c 'npm install -g sass && cd /sass && sass --watch %s'",
+                SassDockerContainerName,
+                Pwd,
+                SassMap);
+            RunCommand(
+                "docker logs --follow %s",
+                SassDockerContainerName);
+        }
+        else
+        {
+            assert(SassMode == SassEnabled);
+            RunCommand("sass --watch %s", SassMap);
+        }
+    }
+    else if (SassWatcherPid > 0)
+    {
+        // Parent process
+        return;
+    }
+    else
+    {
+        PrintError("SASS-Watcher: fork() fehlgeschlagen");
+    }
+}
+
+//
+// Hilfsfunktionen
+//
+
+bool HasOpenat2 = true;  // Kernel vor 5.6 kennen openat2() nicht
+
+// Alle Pfade im ContentDir werden relativ zu ContentDirFd aufgelöst, mit RESOLVE_BENEATH kommt dabei
+// weder per ".." noch per Symlink etwas außerhalb heraus, egal wie der Pfad aussieht.
+// ContentDir wird dabei kanonisch gemacht, auch ohne -c: tsc meldet z.B. absolute Pfade.
+bool OpenContentDir()
+{
+    char CanonicalDir[PATH_MAX];
+    if (realpath(ContentDir, CanonicalDir) == NULL)
+    {
+        PrintError("Konnte das Inhalts-Verzeichnis '%s' nicht auflösen", ContentDir);
+        return false;
+    }
+    memcpy(ContentDir, CanonicalDir, sizeof(ContentDir));
+
+    ContentDirFd = open(ContentDir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (ContentDirFd == -1)
+    {
+        PrintError("Konnte das Inhalts-Verzeichnis '%s' nicht öffnen", ContentDir);
+        return false;
+    }
+
+    open_how How = {};
+    How.flags = O_PATH | O_CLOEXEC;
+    int Fd = syscall(SYS_openat2, ContentDirFd, ".", &How, sizeof(How));
+    if (Fd == -1 && errno == ENOSYS)
+    {
+        // Dann bleibt nur die Prüfung auf ".." im Parser, Symlinks nach draußen werden verfolgt
+        PrintError("openat2() wird vom Kernel nicht unterstützt, Pfade werden ohne RESOLVE_BENEATH aufgelöst");
+        HasOpenat2 = false;
+    }
+
+    if (Fd != -1) close(Fd);
+    return true;
+}
+
+// RelativePath darf mit '/' anfangen (wie die Pfade in Notifications), Flags ohne O_CLOEXEC
+int OpenContentFile(const char *RelativePath, int Flags)
+{
+    while (*RelativePath == '/') ++RelativePath;
+    if (*RelativePath == '\0') RelativePath = ".";
+
+    if (!HasOpenat2)
+    {
+        return openat(ContentDirFd, RelativePath, Flags | O_CLOEXEC);
+    }
+
+    open_how How = {};
+    How.flags   = Flags | O_CLOEXEC;
+    How.resolve = RESOLVE_BENEATH;
+
+    int Fd;
+    do Fd = syscall(SYS_openat2, ContentDirFd, RelativePath, &How, sizeof(How));
+    while (Fd == -1 && (errno == EINTR || errno == EAGAIN));
+
+    return Fd;
+}
+
+bool StatContentFile(const char *RelativePath, struct stat *Stat)
+{
+    int Fd = OpenContentFile(RelativePath, O_PATH);
+    if (Fd == -1)
+    {
+        return false;
+    }
+
+    bool Result = fstatat(Fd, "", Stat, AT_EMPTY_PATH) == 0;
+    close(Fd);
+    return Result;
+}
+
+char *ReadEntireFd(int Fd, size_t *Size)
+{
+    struct stat Stat;
+    if (fstat(Fd, &Stat) != 0 || !S_ISREG(Stat.st_mode))
+    {
+        return NULL;
+    }
+
+    size_t FileSize = Stat.st_size;
+    char *Buffer = (char *)malloc(FileSize + 1);
+    for (size_t Position = 0; Position < FileSize;)
+    {
+        ssize_t BytesRead = read(Fd, &Buffer[Position], FileSize - Position);
+        if (BytesRead <= 0)
+        {
+            if (BytesRead == -1 && errno == EINTR) continue;
+
+            PrintError("ReadEntireFd: Es wurde nicht die ganze Datei gelesen");
+            free(Buffer);
+            return NULL;
+        }
+
+        Position += BytesRead;
+    }
+
+    Buffer[FileSize] = '\0';
+    if (Size != NULL) *Size = FileSize;
+
+    return Buffer;
+}
+
+char *ReadEntireContentFile(const char *Filename, size_t *Size)
+{
+    int Fd = OpenContentFile(Filename, O_RDONLY);
+    if (Fd == -1)
+    {
+        PrintError("ReadEntireContentFile: Konnte %s nicht öffnen", Filename);
+        return NULL;
+    }
+
+    char *Buffer = ReadEntireFd(Fd, Size);
+    close(Fd);
+    return Buffer;
+}
+
+//
+// HTTP-Parser
+//
+
+// Der Parser arbeitet direkt auf dem RequestBuffer der Verbindung und kann nach jedem read()
+// mit dem gewachsenen Buffer erneut aufgerufen werden. Bereits vollständig gelesene Zeilen
+// werden dabei nicht noch einmal angefasst.
+
+const size_t MaxRequestLineSize = 4096;
+
+enum http_parse_state { ParseRequestLine, ParseHeaderLine, ParseBody, ParseDone };
+enum http_parse_result { ParseIncomplete, ParseComplete, ParseFailed };
+
+struct http_parser
+{
+    http_parse_state State;
+    size_t           Position;     // Anfang der nächsten noch nicht verarbeiteten Zeile
+    const char      *ErrorStatus;  // Bei ParseFailed, z.B. HttpStatusBadRequest
+};
+
+bool IsTokenChar(char C)
+{
+    return isalnum((unsigned char)C) || strchr("!#$%&'*+-.^_`|~", C) != NULL;
+}
+
+int HexDigitValue(char C)
+{
+    if (C >= '0' && C <= '9') return C - '0';
+    if (C >= 'a' && C <= 'f') return C - 'a' + 10;
+    if (C >= 'A' && C <= 'F') return C - 'A' + 10;
+    return -1;
+}
+
+// Dekodiert %XX-Sequenzen nach Output. Das Ergebnis ist nie länger als die Eingabe, Output darf
+// deshalb auch Data selbst sein.
+bool PercentDecode(const char *Data, size_t Size, char *Output, size_t *OutputSize)
+{
+    size_t Out = 0;
+    for (size_t In = 0; In < Size; ++In)
+    {
+        char C = Data[In];
+        if (C == '%')
+        {
+            if (In + 2 >= Size) return false;
+            int High = HexDigitValue(Data[In + 1]);
+            int Low  = HexDigitValue(Data[In + 2]);
+            if (High < 0 || Low < 0) return false;
+
+            C = (char)(High * 16 + Low);
+            if (C == '\0') return false;
+            In += 2;
+        }
+
+        Output[Out++] = C;
+    }
+
+    *OutputSize = Out;
+    return true;
+}
+
+// ".." als Pfadsegment würde aus dem ContentDir herausführen
+bool ContainsDotDotSegment(str Path)
+{
+    const char *At  = Path.Data;
+    const char *End = Path.Data + Path.Size;
+    while (At < End)
+    {
+        const char *SegmentStart = At;
+        while (At < End && *At != '/') ++At;
+        if (At - SegmentStart == 2 && SegmentStart[0] == '.' && SegmentStart[1] == '.')
+        {
+            return true;
+        }
+
+        ++At;
+    }
+
+    return false;
+}
+
+const char *ParseRequestLineInto(request *Request, request_arena *Arena, char *Line, size_t LineSize)
+{
+    char *At  = Line;
+    char *End = Line + LineSize;
+
+    // Method
+    char *MethodStart = At;
+    while (At < End && IsTokenChar(*At)) ++At;
+    if (At == MethodStart || At == End || *At != ' ') return HttpStatusBadRequest;
+    Request->Method = str{MethodStart, (size_t)(At - MethodStart)};
+    ++At;
+
+    // Request Target
+    char *TargetStart = At;
+    while (At < End && *At != ' ') ++At;
+    if (At == TargetStart || At == End) return HttpStatusBadRequest;
+    Request->Target = str{TargetStart, (size_t)(At - TargetStart)};
+    char *TargetEnd = At;
+    ++At;
+
+    // HTTP-Version
+    str Version = str{At, (size_t)(End - At)};
+    if (Version.Size != 8 || strncmp(Version.Data, "HTTP/", 5) != 0 || !isdigit((unsigned char)Version.Data[5]) || Version.Data[6] != '.' || !isdigit((unsigned char)Version.Data[7]))
+    {
+        return HttpStatusBadRequest;
+    }
+
+    if (Version.Data[5] != '1')
+    {
+        return HttpStatusVersionNotSupported;
+    }
+
+    Request->VersionMinor = Version.Data[7] - '0';
+
+    // Absolute Form (http://host/path) auf den Pfad reduzieren
+    char *PathStart = TargetStart;
+    if (*PathStart != '/')
+    {
+        char *SchemeEnd = (char *)memmem(PathStart, TargetEnd - PathStart, "://", 3);
+        if (SchemeEnd == NULL) return HttpStatusBadRequest;
+
+        PathStart = (char *)memchr(SchemeEnd + 3, '/', TargetEnd - (SchemeEnd + 3));
+        if (PathStart == NULL) PathStart = TargetEnd;
+    }
+
+    char *QueryStart = (char *)memchr(PathStart, '?', TargetEnd - PathStart);
+    char *PathEnd    = QueryStart != NULL ? QueryStart : TargetEnd;
+    Request->Query   = QueryStart != NULL ? str{QueryStart + 1, (size_t)(TargetEnd - QueryStart - 1)} : str{TargetEnd, 0};
+
+    while (PathStart < PathEnd && *PathStart == '/') ++PathStart; // Die führenden '/' überspringen
+
+    // In die Arena dekodieren, Target bleibt so, wie es gesendet wurde
+    size_t PathSize    = PathEnd - PathStart;
+    char  *DecodedPath = (char *)ArenaPush(Arena, PathSize);
+    if (DecodedPath == NULL)                                      return HttpStatusUriTooLong;
+    if (!PercentDecode(PathStart, PathSize, DecodedPath, &PathSize)) return HttpStatusBadRequest;
+    Request->Path = str{DecodedPath, PathSize};
+
+    if (Request->Path.Size >= PATH_MAX - 1 - strlen("/index.html")) return HttpStatusUriTooLong;
+    if (ContainsDotDotSegment(Request->Path))                     return HttpStatusBadRequest;
+
+    return NULL;
+}
+
+const char *ParseHeaderLineInto(request *Request, char *Line, size_t LineSize)
+{
+    char *End = Line + LineSize;
+
+    // Obsolete line folding wird nicht unterstützt (RFC 7230 3.2.4)
+    if (*Line == ' ' || *Line == '\t') return HttpStatusBadRequest;
+
+    char *At = Line;
+    while (At < End && IsTokenChar(*At)) ++At;
+    if (At == Line || At == End || *At != ':') return HttpStatusBadRequest;
+    str Name = str{Line, (size_t)(At - Line)};
+    ++At;
+
+    while (At < End && (*At == ' ' || *At == '\t')) ++At;
+    while (End > At && (End[-1] == ' ' || End[-1] == '\t')) --End;
+    str Value = str{At, (size_t)(End - At)};
+
+    if (Request->NumHeaders == MaxRequestHeaders) return HttpStatusHeaderTooLarge;
+    Request->Headers[Request->NumHeaders++] = request_header{Name, Value};
+
+    return NULL;
+}
+
+// Nach dem Header-Block: entscheiden, ob noch ein Body folgt
+const char *ParseFramingHeaders(request *Request)
+{
+    if (FindHeader(Request, "Transfer-Encoding") != NULL)
+    {
+        return HttpStatusNotImplemented;
+    }
+
+    Request->ContentLength = 0;
+    const str *ContentLength = FindHeader(Request, "Content-Length");
+    if (ContentLength != NULL)
+    {
+        if (ContentLength->Size == 0 || ContentLength->Size > 18) return HttpStatusBadRequest;
+        for (size_t I = 0; I < ContentLength->Size; ++I)
+        {
+            char C = ContentLength->Data[I];
+            if (!isdigit((unsigned char)C)) return HttpStatusBadRequest;
+            Request->ContentLength = Request->ContentLength * 10 + (C - '0');
+        }
+    }
+
+    return NULL;
+}
+
+// Buffer[0..Size) ist alles, was bisher für diesen Request (und evtl. folgende) gelesen wurde,
+// Capacity die Größe, bis zu der der Buffer höchstens wachsen kann.
+http_parse_result ParseRequest(http_parser *Parser, request *Request, request_arena *Arena, char *Buffer, size_t Size, size_t Capacity)
+{
+    while (Parser->State != ParseDone)
+    {
+        if (Parser->State == ParseBody)
+        {
+            // Der Body wird nicht verwendet, muss aber übersprungen werden, damit der nächste Request gefunden wird
+            if (Parser->Position + Request->ContentLength > Capacity)
+            {
+                Parser->ErrorStatus = HttpStatusPayloadTooLarge;
+                return ParseFailed;
+            }
+
+            if (Parser->Position + Request->ContentLength > Size)
+            {
+                return ParseIncomplete;
+            }
+
+            Parser->Position += Request->ContentLength;
+            Parser->State = ParseDone;
+            break;
+        }
+
+        char *Line    = &Buffer[Parser->Position];
+        char *LineEnd = (char *)memchr(Line, '\n', Size - Parser->Position);
+        if (LineEnd == NULL)
+        {
+            size_t PendingLineSize = Size - Parser->Position;
+            if (Parser->State == ParseRequestLine && PendingLineSize > MaxRequestLineSize)
+            {
+                Parser->ErrorStatus = HttpStatusUriTooLong;
+                return ParseFailed;
+            }
+
+            if (Size == Capacity)
+            {
+                Parser->ErrorStatus = Parser->State == ParseRequestLine ? HttpStatusUriTooLong : HttpStatusHeaderTooLarge;
+                return ParseFailed;
+            }
+
+            return ParseIncomplete;
+        }
+
+        size_t NextPosition = (LineEnd - Buffer) + 1;
+        if (LineEnd > Line && LineEnd[-1] == '\r') --LineEnd;
+        size_t LineSize = LineEnd - Line;
+
+        const char *ErrorStatus = NULL;
+        if (Parser->State == ParseRequestLine)
+        {
+            // Leerzeilen vor der Request Line ignorieren (RFC 7230 3.5)
+            if (LineSize != 0)
+            {
+                ErrorStatus = LineSize > MaxRequestLineSize ? HttpStatusUriTooLong : ParseRequestLineInto(Request, Arena, Line, LineSize);
+                Parser->State = ParseHeaderLine;
+            }
+        }
+        else if (LineSize == 0)
+        {
+            ErrorStatus = ParseFramingHeaders(Request);
+            Parser->State = Request->ContentLength > 0 ? ParseBody : ParseDone;
+        }
+        else
+        {
+            ErrorStatus = ParseHeaderLineInto(Request, Line, LineSize);
+        }
+
+        if (ErrorStatus != NULL)
+        {
+            Parser->ErrorStatus = ErrorStatus;
+            return ParseFailed;
+        }
+
+        Parser->Position = NextPosition;
+    }
+
+    return ParseComplete;
+}
+
+//
+// Anfragen-Bearbeitung
+//
+
+// Output ist relativ zu ContentDir, siehe OpenContentFile()
+ResolveRequestFilePathResult ResolveRequestFilePath(str RequestPath, char Output[PATH_MAX], file_version *FileVersion)
+{
+    struct stat Stat;
+    *FileVersion = {};
+
+    if (RequestPath.Size != 0)
+    {
+        snprintf(Output, PATH_MAX, "%.*s", STR_FMT(RequestPath));
+    }
+    else
+    {
+        // Wenn Pfad leer: index.html
+        strncpy(Output, "index.html", PATH_MAX);
+    }
+
+    if (!StatContentFile(Output, &Stat))
+    {
+        // Weder Datei noch Verzeichnis existiert (oder liegt außerhalb von ContentDir)
+        return RequestedFileNotFound;
+    }
+
+    if (S_ISREG(Stat.st_mode))
+    {
+        // Datei gefunden
+        *FileVersion = GetFileVersion(&Stat);
+        return RequestedFileFound;
+    }
+
+    if (!S_ISDIR(Stat.st_mode))
+    {
+        // Könnte ein block device, FIFO, UNIX socket etc. sein
+        return RequestedFileNotFound;
+    }
+
+    // Wenn Verzeichnis ohne '/': 301 zu <dir>/
+    bool EndsWithSlash = Output[strlen(Output) - 1] == '/';
+    if (!EndsWithSlash)
+    {
+        return RedirectToDirectory;
+    }
+
+    // <dir>/index.html
+    strncat(Output, "index.html", PATH_MAX - strlen(Output) - 1);
+
+    bool FileExists = StatContentFile(Output, &Stat) && S_ISREG(Stat.st_mode);
+    if (!FileExists)
+    {
+        return RequestedFileNotFound;
+    }
+
+    *FileVersion = GetFileVersion(&Stat);
+    return RequestedFileFound;
+}
+
+// Dateien unterhalb von --max-depth sieht der Watcher nicht, dafür darf also nichts gecacht werden
+bool IsWatchedRequestPath(str RequestPath)
+{
+    if (MaxDepth == -1)
+    {
+        return true;
+    }
+
+    int Depth = 0;
+    for (size_t I = 0; I < RequestPath.Size; ++I)
+    {
+        if (RequestPath.Data[I] == '/') ++Depth;
+    }
+
+    return Depth <= MaxDepth;
+}
+
+ResolveRequestFilePathResult ResolveRequestFilePathCached(str RequestPath, char Output[PATH_MAX], file_version *FileVersion)
+{
+    if (!IsWatchedRequestPath(RequestPath))
+    {
+        return ResolveRequestFilePath(RequestPath, Output, FileVersion);
+    }
+
+    ResolveRequestFilePathResult Result;
+    if (CacheLookupResolution(RequestPath, &Result, Output, FileVersion))
+    {
+        return Result;
+    }
+
+    uint64_t Generation = __atomic_load_n(&ResolutionGeneration, __ATOMIC_ACQUIRE);
+    uint64_t VersionGeneration = __atomic_load_n(&FileVersionGeneration, __ATOMIC_ACQUIRE);
+    Result = ResolveRequestFilePath(RequestPath, Output, FileVersion);
+    CacheStoreResolution(RequestPath, Generation, VersionGeneration, Result, Output, *FileVersion);
+
+    return Result;
+}
+
+void InitClientScript()
+{
+    uint64_t Hash = HashXx64(ClientScript, sizeof(ClientScript) - 1);
+    snprintf(ClientScriptETag, sizeof(ClientScriptETag), "\"%016llx\"", (unsigned long long)Hash);
+
+    if (InlineClientScript)
+    {
+        TextAppend(&ClientScriptTag, "\n<script type=\"text/javascript\">");
+        TextAppend(&ClientScriptTag, ClientScript, sizeof(ClientScript) - 1);
+        TextAppend(&ClientScriptTag, "</script>\n");
+    }
+    else
+    {
+        char Tag[128];
+        snprintf(Tag, sizeof(Tag), "\n<script src=\"/%s?v=%016llx\" defer></script>\n", ClientScriptPath, (unsigned long long)Hash);
+        TextAppend(&ClientScriptTag, Tag);
+    }
+
+    ClientScriptTagHash = HashXx64(ClientScriptTag.Data, ClientScriptTag.Size);
+}
+
+// If-None-Match ist eine Liste von ETags oder "*", verglichen wird schwach (RFC 7232, 2.3.2), also ohne "W/"
+bool MatchesIfNoneMatch(const request *Request, const char *ETag)
+{
+    const str *IfNoneMatch = FindHeader(Request, "If-None-Match");
+    if (IfNoneMatch == NULL)
+    {
+        return false;
+    }
+
+    const char *At  = IfNoneMatch->Data;
+    const char *End = IfNoneMatch->Data + IfNoneMatch->Size;
+    while (At < End)
+    {
+        while (At < End && (*At == ' ' || *At == '\t' || *At == ',')) ++At;
+        const char *TokenStart = At;
+        while (At < End && *At != ',') ++At;
+        const char *TokenEnd = At;
+        while (TokenEnd > TokenStart && (TokenEnd[-1] == ' ' || TokenEnd[-1] == '\t')) --TokenEnd;
+
+        if (TokenEnd - TokenStart > 2 && TokenStart[0] == 'W' && TokenStart[1] == '/') TokenStart += 2;
+
+        str Token = { TokenStart, (size_t)(TokenEnd - TokenStart) };
+        if (StrEquals(Token, "*") || StrEquals(Token, ETag))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Starker ETag aus dem Dateistand. In HTML steckt außerdem das eingefügte Skript, das sich mit dem
+// Server ändern kann, komprimierte Fassungen sind eigene Repräsentationen mit eigenem ETag.
+void FormatFileETag(const file_version &FileVersion, bool HasInjectedScript, content_encoding Encoding, char Output[24])
+{
+    uint64_t Fields[] =
+    {
+        (uint64_t)FileVersion.Device,
+        (uint64_t)FileVersion.Inode,
+        (uint64_t)FileVersion.MTime.tv_sec,
+        (uint64_t)FileVersion.MTime.tv_nsec,
+        (uint64_t)FileVersion.Size,
+        HasInjectedScript ? ClientScriptTagHash : 0,
+        (uint64_t)Encoding,
+    };
+
+    snprintf(Output, 24, "\"%016llx\"", (unsigned long long)HashXx64(Fields, sizeof(Fields)));
+}
+
+// IMF-fixdate (RFC 7231, 7.1.1.1), z.B. "Sun, 06 Nov 1994 08:49:37 GMT"
+void FormatHttpDate(time_t Time, char Output[32])
+{
+    tm Tm;
+    gmtime_r(&Time, &Tm);
+    strftime(Output, 32, "%a, %d %b %Y %H:%M:%S GMT", &Tm);
+}
+
+bool ParseHttpDate(str Value, time_t *Time)
+{
+    char Text[64];
+    if (Value.Size >= sizeof(Text))
+    {
+        return false;
+    }
+
+    memcpy(Text, Value.Data, Value.Size);
+    Text[Value.Size] = '\0';
+
+    tm Tm = {};
+    const char *End = strptime(Text, "%a, %d %b %Y %H:%M:%S GMT", &Tm);
+    if (End == NULL || *End != '\0')
+    {
+        return false;
+    }
+
+    *Time = timegm(&Tm);
+    return true;
+}
+
+// RFC 7232, 6: If-None-Match hat Vorrang, If-Modified-Since zählt nur ohne. Die Zeit hat nur
+// Sekundenauflösung, Browser schicken aber ohnehin beide Header mit.
+bool IsNotModified(const request *Request, const char *ETag, time_t LastModified)
+{
+    if (!StrEquals(Request->Method, "GET") && !StrEquals(Request->Method, "HEAD"))
+    {
+        return false;
+    }
+
+    if (FindHeader(Request, "If-None-Match") != NULL)
+    {
+        return MatchesIfNoneMatch(Request, ETag);
+    }
+
+    const str *IfModifiedSince = FindHeader(Request, "If-Modified-Since");
+    time_t Since;
+    return IfModifiedSince != NULL && ParseHttpDate(*IfModifiedSince, &Since) && LastModified <= Since;
+}
+
+void HandleClientScriptRequest(request *Request, response *Response)
+{
+    // Nur die URL mit dem aktuellen Hash ist unveränderlich, alles andere wird jedes Mal geprüft
+    char VersionQuery[32];
+    snprintf(VersionQuery, sizeof(VersionQuery), "v=%.16s", ClientScriptETag + 1);
+    const char *CacheControl = StrEquals(Request->Query, VersionQuery) ? "public, max-age=31536000, immutable" : "no-cache";
+
+    Response->ContentSource = ContentFromStatic;
+    Response->Content       = (char *)ClientScript;
+    AddHeader(Response, "ETag", "%s", ClientScriptETag);
+    AddHeader(Response, "Cache-Control", "%s", CacheControl);
+
+    if (MatchesIfNoneMatch(Request, ClientScriptETag))
+    {
+        Response->Status      = HttpStatusNotModified;
+        Response->ContentSize = 0;
+        return;
+    }
+
+    Response->Status      = HttpStatusOk;
+    Response->ContentSize = sizeof(ClientScript) - 1;
+    AddHeader(Response, HttpHeaderContentType, "text/javascript; charset=utf-8");
+}
+
+const char *GetEncodingName(content_encoding Encoding)
+{
+    switch (Encoding)
+    {
+        case EncodingIdentity: return "identity";
+        case EncodingGzip:     return "gzip";
+        case EncodingDeflate:  return "deflate";
+    }
+
+    return "identity";
+}
+
+// Bilder, Videos, Fonts und Archive sind schon komprimiert, dort bringt gzip nichts
+bool IsCompressibleContentType(const char *ContentType)
+{
+    const char *Compressible[] =
+    {
+        "application/javascript", "application/ecmascript", "application/json", "application/xml",
+        "application/wasm", "image/svg+xml", "image/x-icon",
+    };
+
+    if (strncmp(ContentType, "text/", 5) == 0)
+    {
+        return true;
+    }
+
+    for (size_t I = 0; I < ARRAY_LEN(Compressible); ++I)
+    {
+        if (strcmp(ContentType, Compressible[I]) == 0) return true;
+    }
+
+    size_t Size = strlen(ContentType);
+    return (Size > 4 && strcmp(ContentType + Size - 4, "+xml")  == 0) ||
+           (Size > 5 && strcmp(ContentType + Size - 5, "+json") == 0);
+}
+
+// "q=0.5" in Tausendsteln, ungültige Werte zählen als 0
+int ParseQuality(str Value)
+{
+    if (Value.Size < 3 || (Value.Data[0] != 'q' && Value.Data[0] != 'Q') || Value.Data[1] != '=')
+    {
+        return 0;
+    }
+
+    const char *At  = Value.Data + 2;
+    const char *End = Value.Data + Value.Size;
+    if (*At != '0' && *At != '1') return 0;
+
+    int Quality = (*At++ - '0') * 1000;
+    if (At < End && *At == '.')
+    {
+        ++At;
+        for (int Scale = 100; At < End && isdigit((unsigned char)*At); ++At, Scale /= 10)
+        {
+            Quality += (*At - '0') * Scale;
+        }
+    }
+
+    return At == End && Quality <= 1000 ? Quality : 0;
+}
+
+// Accept-Encoding nach RFC 7231, 5.3.4. Bei gleicher Gewichtung gewinnt gzip, "*" gilt für alles,
+// was nicht explizit genannt ist, und q=0 schließt ein Encoding aus.
+content_encoding NegotiateContentEncoding(const request *Request)
+{
+    const str *AcceptEncoding = FindHeader(Request, "Accept-Encoding");
+    if (AcceptEncoding == NULL)
+    {
+        return EncodingIdentity;
+    }
+
+    int GzipQuality = -1, DeflateQuality = -1, AnyQuality = -1;  // -1 = nicht genannt
+    const char *At  = AcceptEncoding->Data;
+    const char *End = AcceptEncoding->Data + AcceptEncoding->Size;
+    while (At < End)
+    {
+        while (At < End && (*At == ' ' || *At == '\t' || *At == ',')) ++At;
+        const char *NameStart = At;
+        while (At < End && *At != ',' && *At != ';' && *At != ' ' && *At != '\t') ++At;
+        str Name = { NameStart, (size_t)(At - NameStart) };
+
+        int Quality = 1000;
+        while (At < End && *At != ',')
+        {
+            while (At < End && (*At == ' ' || *At == '\t' || *At == ';')) ++At;
+            const char *ParamStart = At;
+            while (At < End && *At != ',' && *At != ';' && *At != ' ' && *At != '\t') ++At;
+            if (At > ParamStart) Quality = ParseQuality(str{ ParamStart, (size_t)(At - ParamStart) });
+        }
+
+        if (StrEqualsNoCase(Name, "gzip") || StrEqualsNoCase(Name, "x-gzip")) GzipQuality    = Quality;
+        else if (StrEqualsNoCase(Name, "deflate"))                            DeflateQuality = Quality;
+        else if (StrEquals(Name, "*"))                                        AnyQuality     = Quality;
+    }
+
+    if (GzipQuality    == -1) GzipQuality    = AnyQuality;
+    if (DeflateQuality == -1) DeflateQuality = AnyQuality;
+
+    if (GzipQuality > 0 && GzipQuality >= DeflateQuality) return EncodingGzip;
+    if (DeflateQuality > 0)                               return EncodingDeflate;
+    return EncodingIdentity;
+}
+
+// Vorkomprimierte Datei neben der angefragten (z.B. "app.js.gz" aus dem Build). Sie muss mindestens so
+// neu sein wie das Original, sonst wäre sie veraltet.
+bool FindPrecompressedFile(const char *Path, const file_version &FileVersion, char Output[PATH_MAX], file_version *CompressedVersion)
+{
+    if (snprintf(Output, PATH_MAX, "%s.gz", Path) >= PATH_MAX)
+    {
+        return false;
+    }
+
+    struct stat Stat;
+    if (!StatContentFile(Output, &Stat) || !S_ISREG(Stat.st_mode))
+    {
+        return false;
+    }
+
+    bool IsOlder =
+        Stat.st_mtim.tv_sec < FileVersion.MTime.tv_sec ||
+        (Stat.st_mtim.tv_sec == FileVersion.MTime.tv_sec && Stat.st_mtim.tv_nsec < FileVersion.MTime.tv_nsec);
+    if (IsOlder)
+    {
+        return false;
+    }
+
+    *CompressedVersion = GetFileVersion(&Stat);
+    return true;
+}
+
+struct byte_range
+{
+    uint64_t First;
+    uint64_t Last;  // Inklusive
+};
+
+enum range_result { RangeIgnored, RangeUnsatisfiable, RangeSatisfiable };
+
+// "bytes=0-99,200-,-50" nach RFC 7233, 2.1. Syntaktisch ungültige Header und mehr als MaxRanges
+// Bereiche werden ignoriert (dann gibt es die ganze Datei), Bereiche hinter dem Dateiende verworfen.
+range_result ParseRangeHeader(str Value, uint64_t FileSize, byte_range Ranges[MaxRanges], int *NumRanges)
+{
+    const char *Prefix = "bytes=";
+    if (Value.Size < strlen(Prefix) || strncasecmp(Value.Data, Prefix, strlen(Prefix)) != 0)
+    {
+        return RangeIgnored;
+    }
+
+    *NumRanges = 0;
+    int NumSpecs = 0;
+    const char *At  = Value.Data + strlen(Prefix);
+    const char *End = Value.Data + Value.Size;
+    while (At < End)
+    {
+        while (At < End && (*At == ' ' || *At == '\t' || *At == ',')) ++At;
+        if (At == End) break;
+        if (++NumSpecs > MaxRanges) return RangeIgnored;
+
+        bool HasFirst = false, HasLast = false;
+        uint64_t First = 0, Last = 0;
+        for (; At < End && isdigit((unsigned char)*At); ++At, HasFirst = true)
+        {
+            if (First > (UINT64_MAX - 9) / 10) return RangeIgnored;
+            First = First * 10 + (*At - '0');
+        }
+
+        if (At == End || *At != '-') return RangeIgnored;
+        ++At;
+
+        for (; At < End && isdigit((unsigned char)*At); ++At, HasLast = true)
+        {
+            if (Last > (UINT64_MAX - 9) / 10) return RangeIgnored;
+            Last = Last * 10 + (*At - '0');
+        }
+
+        while (At < End && (*At == ' ' || *At == '\t')) ++At;
+        if (At < End && *At != ',') return RangeIgnored;
+        if (!HasFirst && !HasLast)            return RangeIgnored;
+        if (HasFirst && HasLast && Last < First) return RangeIgnored;
+
+        byte_range Range;
+        if (!HasFirst)
+        {
+            // Suffix: die letzten Last Bytes
+            if (Last == 0 || FileSize == 0) continue;
+            Range = { Last < FileSize ? FileSize - Last : 0, FileSize - 1 };
+        }
+        else
+        {
+            if (First >= FileSize) continue;
+            Range = { First, HasLast && Last < FileSize ? Last : FileSize - 1 };
+        }
+
+        Ranges[(*NumRanges)++] = Range;
+    }
+
+    if (NumSpecs == 0)
+    {
+        return RangeIgnored;
+    }
+
+    return *NumRanges == 0 ? RangeUnsatisfiable : RangeSatisfiable;
+}
+
+// If-Range (RFC 7233, 3.2): Range nur, wenn der Client noch denselben Stand hat. ETags werden stark
+// verglichen, ein Datum muss genau Last-Modified sein.
+bool IsIfRangeSatisfied(const request *Request, const char *ETag, const char *LastModified)
+{
+    const str *IfRange = FindHeader(Request, "If-Range");
+    if (IfRange == NULL)
+    {
+        return true;
+    }
+
+    return StrEquals(*IfRange, IfRange->Size > 0 && IfRange->Data[0] == '"' ? ETag : LastModified);
+}
+
+// Status, Content-Type und ggf. Content-Range für eine Datei, deren Inhalt komplett in ContentParts[0]
+// steht. Bei Range-Requests werden daraus die angefragten Ausschnitte, bei ContentFromFile weiterhin
+// direkt per sendfile() aus der Datei.
+void PrepareFileContent(request *Request, response *Response, const char *ContentType, const char *ETag, const char *LastModified)
+{
+    AddHeader(Response, "Accept-Ranges", "bytes");
+
+    uint64_t FileSize = Response->ContentSize;
+    content_part Whole = Response->ContentParts[0];
+
+    const str *RangeHeader = FindHeader(Request, "Range");
+    byte_range Ranges[MaxRanges];
+    int NumRanges = 0;
+    range_result RangeResult = RangeIgnored;
+    if (RangeHeader != NULL && StrEquals(Request->Method, "GET") && IsIfRangeSatisfied(Request, ETag, LastModified))
+    {
+        RangeResult = ParseRangeHeader(*RangeHeader, FileSize, Ranges, &NumRanges);
+    }
+
+    switch (RangeResult)
+    {
+        case RangeIgnored:
+        {
+            Response->Status = HttpStatusOk;
+            AddHeader(Response, HttpHeaderContentType, ContentType);
+            return;
+        }
+
+        case RangeUnsatisfiable:
+        {
+            Response->Status = HttpStatusRangeNotSatisfiable;
+            AddHeader(Response, "Content-Range", "bytes */%llu", (unsigned long long)FileSize);
+
+            Response->ContentParts[0] = { "", 0, 0 };
+            Response->ContentSize     = 0;
+            return;
+        }
+
+        case RangeSatisfiable:
+            break;
+    }
+
+    Response->Status = HttpStatusPartialContent;
+
+    if (NumRanges == 1)
+    {
+        uint64_t Size = Ranges[0].Last - Ranges[0].First + 1;
+        AddHeader(Response, HttpHeaderContentType, ContentType);
+        AddHeader(Response, "Content-Range", "bytes %llu-%llu/%llu",
+                  (unsigned long long)Ranges[0].First, (unsigned long long)Ranges[0].Last, (unsigned long long)FileSize);
+
+        Response->ContentParts[0] = {
+            Whole.Data != NULL ? Whole.Data + Ranges[0].First : NULL,
+            Whole.FileOffset + (off_t)Ranges[0].First,
+            (size_t)Size };
+        Response->ContentSize = Size;
+        return;
+    }
+
+    // multipart/byteranges (RFC 7233, Anhang A). Die Grenze hängt am ETag, im Inhalt kommt sie praktisch nie vor.
+    char Boundary[32];
+    snprintf(Boundary, sizeof(Boundary), "livegate-%.16s", ETag + 1);
+
+    // Die Köpfe der Teile kommen in die Arena, der Abschluss "--Grenze--" zählt als Kopf nach dem letzten Teil
+    content_part Heads[MaxRanges + 1];
+    for (int I = 0; I <= NumRanges; ++I)
+    {
+        size_t Size = 0;
+        char *Head = I < NumRanges ?
+            ArenaPrintf(Response->Arena, &Size, "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %llu-%llu/%llu\r\n\r\n",
+                        Boundary, ContentType,
+                        (unsigned long long)Ranges[I].First, (unsigned long long)Ranges[I].Last, (unsigned long long)FileSize) :
+            ArenaPrintf(Response->Arena, &Size, "\r\n--%s--\r\n", Boundary);
+
+        if (Head == NULL)
+        {
+            // Passt nicht in die Arena (sehr lange Content-Types), dann eben die ganze Datei
+            PrintError("PrepareFileContent: Kein Platz für die multipart/byteranges-Köpfe");
+            Response->Status = HttpStatusOk;
+            AddHeader(Response, HttpHeaderContentType, ContentType);
+            return;
+        }
+
+        Heads[I] = { Head, 0, Size };
+    }
+
+    AddHeader(Response, HttpHeaderContentType, "multipart/byteranges; boundary=%s", Boundary);
+
+    Response->NumContentParts = 0;
+    Response->ContentSize     = 0;
+    for (int I = 0; I <= NumRanges; ++I)
+    {
+        Response->ContentParts[Response->NumContentParts++] = Heads[I];
+        Response->ContentSize += Heads[I].Size;
+
+        if (I == NumRanges) break;
+
+        uint64_t Size = Ranges[I].Last - Ranges[I].First + 1;
+        Response->ContentParts[Response->NumContentParts++] = {
+            Whole.Data != NULL ? Whole.Data + Ranges[I].First : NULL,
+            Whole.FileOffset + (off_t)Ranges[I].First,
+            (size_t)Size };
+        Response->ContentSize += Size;
+    }
+}
+
+// ETag und Last-Modified müssen genau zum gesendeten Inhalt passen. Die Datei kann sich seit der
+// Auflösung geändert haben, deshalb kommt ContentVersion von der geöffneten Datei bzw. dem Cache-Eintrag.
+void AddValidatorHeaders(response *Response, const file_version &ContentVersion, bool HasInjectedScript, content_encoding Encoding, char ETag[24], char LastModified[32])
+{
+    FormatFileETag(ContentVersion, HasInjectedScript, Encoding, ETag);
+    FormatHttpDate(ContentVersion.MTime.tv_sec, LastModified);
+    AddHeader(Response, "ETag", "%s", ETag);
+    AddHeader(Response, "Last-Modified", "%s", LastModified);
+    AddHeader(Response, "Cache-Control", "no-cache");
+}
+
+// Der Browser soll jedes Mal nachfragen (no-cache), unveränderte Dateien kosten dann nur einen 304 ohne
+// Inhalt, ohne dass die Datei geöffnet wird. Dafür reicht der Stand aus der Auflösung. true, wenn die
+// Response damit schon fertig ist.
+bool PrepareNotModified(request *Request, response *Response, const file_version &ContentVersion, bool HasInjectedScript, content_encoding Encoding)
+{
+    char ETag[24];
+    FormatFileETag(ContentVersion, HasInjectedScript, Encoding, ETag);
+    if (!IsNotModified(Request, ETag, ContentVersion.MTime.tv_sec))
+    {
+        return false;
+    }
+
+    char LastModified[32];
+    AddValidatorHeaders(Response, ContentVersion, HasInjectedScript, Encoding, ETag, LastModified);
+
+    Response->Status        = HttpStatusNotModified;
+    Response->ContentSource = ContentFromStatic;
+    Response->Content       = (char *)"";
+    Response->ContentSize   = 0;
+
+    return true;
+}
+
+void HandleRequest(request *Request, response *Response)
+{
+    switch (ResolveRequestFilePathCached(Request->Path, Request->ResolvedPath, &Request->ResolvedFileVersion))
+    {
+        case RequestedFileNotFound:
+        {
+            PrintError("HandleRequest: Dateipfad für '%.*s' konnte nicht aufgelöst werden", STR_FMT(Request->Path));
+
+            Response->Status = HttpStatusNotFound;
+            AddHeader(Response, HttpHeaderContentType, "text/html");
+
+            Response->ContentSource = ContentFromStatic;
+            Response->Content       = (char *)"Datei wurde nicht gefunden";
+            Response->ContentSize   = strlen(Response->Content);
+
+            return;
+        }
+
+        case RedirectToDirectory:
+        {
+            char Location[PATH_MAX];
+            snprintf(Location, PATH_MAX, "/%.*s/", STR_FMT(Request->Path));
+            PrintError("HandleRequest: Leite '%.*s' weiter zu '%s'", STR_FMT(Request->Path), Location);
+
+            Response->Status = HttpStatusMovedPermanently;
+            AddHeader(Response, HttpHeaderContentType, "text/html");
+            AddHeader(Response, HttpHeaderLocation, "%s", Location);
+
+            Response->ContentSource = ContentFromStatic;
+            Response->Content       = (char *)"";
+            Response->ContentSize   = 0;
+
+            return;
+        }
+
+        case RequestedFileFound:
+            break;
+
+        default: assert(!"Ungültiges Ergebnis");
+    }
+
+    const char *ContentType = GetContentTypeForFilename(Request->ResolvedPath);
+    bool ShouldInject = IsHtmlPath(Request->ResolvedPath);
+
+    // Textformate gehen komprimiert raus, wenn der Client das kann: bevorzugt aus einer .gz-Datei
+    // daneben, sonst einmal pro Dateistand komprimiert aus dem Cache. Range-Requests bekommen immer
+    // den unkomprimierten Inhalt, damit sich die Bereiche auf die Datei beziehen.
+    content_encoding Encoding = EncodingIdentity;
+    file_version ContentVersion = Request->ResolvedFileVersion;
+    char PrecompressedPath[PATH_MAX];
+    bool UsePrecompressed = false;
+    if (IsCompressibleContentType(ContentType))
+    {
+        AddHeader(Response, "Vary", "Accept-Encoding");
+
+        bool IsRangeRequest = FindHeader(Request, "Range") != NULL && StrEquals(Request->Method, "GET");
+        if (!IsRangeRequest) Encoding = NegotiateContentEncoding(Request);
+    }
+
+    if (Encoding == EncodingGzip && !ShouldInject)
+    {
+        UsePrecompressed = FindPrecompressedFile(Request->ResolvedPath, Request->ResolvedFileVersion, PrecompressedPath, &ContentVersion);
+    }
+
+    bool CanCompress =
+        CacheBudget != 0 &&
+        IsWatchedRequestPath(Request->Path) &&
+        (size_t)Request->ResolvedFileVersion.Size >= MinCompressedFileSize &&
+        (size_t)Request->ResolvedFileVersion.Size <= MaxCachedFileSize;
+    if (!UsePrecompressed && !CanCompress)
+    {
+        Encoding = EncodingIdentity;
+    }
+
+    if (PrepareNotModified(Request, Response, ContentVersion, ShouldInject, Encoding))
+    {
+        return;
+    }
+
+    // Für die Response, kommen vom tatsächlich gesendeten Inhalt
+    char ETag[24];
+    char LastModified[32];
+
+    if (UsePrecompressed)
+    {
+        int FileFd = OpenContentFile(PrecompressedPath, O_RDONLY);
+        struct stat Stat;
+        if (FileFd != -1 && fstat(FileFd, &Stat) == 0)
+        {
+            Response->Status = HttpStatusOk;
+            AddValidatorHeaders(Response, GetFileVersion(&Stat), ShouldInject, Encoding, ETag, LastModified);
+            AddHeader(Response, HttpHeaderContentType, ContentType);
+            AddHeader(Response, "Content-Encoding", "gzip");
+
+            Response->ContentSource   = ContentFromFile;
+            Response->FileFd          = FileFd;
+            Response->ContentSize     = Stat.st_size;
+            Response->ContentParts[0] = { NULL, 0, Response->ContentSize };
+            Response->NumContentParts = 1;
+
+            return;
+        }
+
+        // Inzwischen gelöscht: dann eben unkomprimiert, der Inhalt ist derselbe. Der Client hat dafür
+        // evtl. schon das ETag der unkomprimierten Fassung, oben wurde aber nur das der .gz-Datei geprüft.
+        if (FileFd != -1) close(FileFd);
+        Encoding = EncodingIdentity;
+        if (PrepareNotModified(Request, Response, Request->ResolvedFileVersion, ShouldInject, Encoding))
+        {
+            return;
+        }
+    }
+    else if (Encoding != EncodingIdentity)
+    {
+        cache_entry *Compressed = CacheAcquireCompressed(Request->ResolvedPath, Request->ResolvedFileVersion, Encoding, ShouldInject);
+        if (Compressed != NULL)
+        {
+            Response->Status = HttpStatusOk;
+            AddValidatorHeaders(Response, Compressed->FileVersion, ShouldInject, Encoding, ETag, LastModified);
+            AddHeader(Response, HttpHeaderContentType, ContentType);
+            AddHeader(Response, "Content-Encoding", "%s", GetEncodingName(Encoding));
+
+            Response->ContentSource = ContentFromCache;
+            Response->CacheEntry    = Compressed;
+            Response->Content       = Compressed->Content;
+            Response->ContentSize   = Compressed->ContentSize;
+
+            return;
+        }
+
+        // Wie oben: unkomprimiert, also auch gegen dieses ETag prüfen
+        Encoding = EncodingIdentity;
+        if (PrepareNotModified(Request, Response, Request->ResolvedFileVersion, ShouldInject, Encoding))
+        {
+            return;
+        }
+    }
+
+    // Kleine Dateien kommen aus dem Cache, der Rest wird direkt von der Platte gelesen
+    cache_entry *CacheEntry = IsWatchedRequestPath(Request->Path) ? CacheAcquireFile(Request->ResolvedPath, Request->ResolvedFileVersion) : NULL;
+
+    if (!ShouldInject && CacheEntry != NULL)
+    {
+        Response->ContentSource   = ContentFromCache;
+        Response->CacheEntry      = CacheEntry;
+        Response->Content         = CacheEntry->Content;
+        Response->ContentSize     = CacheEntry->FileVersion.Size;
+        Response->ContentParts[0] = { Response->Content, 0, Response->ContentSize };
+        Response->NumContentParts = 1;
+
+        AddValidatorHeaders(Response, CacheEntry->FileVersion, ShouldInject, Encoding, ETag, LastModified);
+        PrepareFileContent(Request, Response, ContentType, ETag, LastModified);
+        return;
+    }
+
+    if (!ShouldInject)
+    {
+        // Ohne Injektion muss der Inhalt nie in den Speicher, er wird später per sendfile() gesendet
+        int FileFd = OpenContentFile(Request->ResolvedPath, O_RDONLY);
+        struct stat Stat;
+        if (FileFd == -1 || fstat(FileFd, &Stat) != 0)
+        {
+            PrintError("HandleRequest: Konnte die angeforderte Datei nicht öffnen");
+            if (FileFd != -1) close(FileFd);
+
+            Response->Status = HttpStatusInternalError;
+            AddHeader(Response, HttpHeaderContentType, "text/html");
+
+            Response->ContentSource = ContentFromStatic;
+            Response->Content       = (char *)"Datei konnte nicht gelesen werden";
+            Response->ContentSize   = strlen(Response->Content);
+
+            return;
+        }
+
+        Response->ContentSource   = ContentFromFile;
+        Response->FileFd          = FileFd;
+        Response->ContentSize     = Stat.st_size;
+        Response->ContentParts[0] = { NULL, 0, Response->ContentSize };
+        Response->NumContentParts = 1;
+
+        AddValidatorHeaders(Response, GetFileVersion(&Stat), ShouldInject, Encoding, ETag, LastModified);
+        PrepareFileContent(Request, Response, ContentType, ETag, LastModified);
+        return;
+    }
+
+    // Angefragte Datei lesen, die Response übernimmt den Inhalt ohne Kopie
+
+    size_t InjectionOffset;
+    file_version FileVersion;
+    if (CacheEntry != NULL)
+    {
+        Response->ContentSource = ContentFromCache;
+        Response->CacheEntry    = CacheEntry;
+        Response->Content       = CacheEntry->Content;
+        Response->ContentSize   = CacheEntry->FileVersion.Size;
+        InjectionOffset         = GetInjectionOffset(CacheEntry);
+        FileVersion             = CacheEntry->FileVersion;
+    }
+    else
+    {
+        int FileFd = OpenContentFile(Request->ResolvedPath, O_RDONLY);
+        struct stat Stat;
+        size_t FileSize = 0;
+        char *FileBuffer = NULL;
+        if (FileFd != -1 && fstat(FileFd, &Stat) == 0) FileBuffer = ReadEntireFd(FileFd, &FileSize);
+        if (FileFd != -1) close(FileFd);
+
+        if (FileBuffer == NULL)
+        {
+            PrintError("HandleRequest: Konnte die angeforderte Datei nicht lesen");
+
+            Response->Status = HttpStatusInternalError;
+            AddHeader(Response, HttpHeaderContentType, "text/html");
+
+            Response->ContentSource = ContentFromStatic;
+            Response->Content       = (char *)"Datei konnte nicht gelesen werden";
+            Response->ContentSize   = strlen(Response->Content);
+
+            return;
+        }
+
+        Response->ContentSource = ContentFromBuffer;
+        Response->Content       = FileBuffer;
+        Response->ContentSize   = FileSize;
+        InjectionOffset         = FindInjectionOffset(FileBuffer, FileSize);
+        FileVersion             = GetFileVersion(&Stat);
+    }
+
+    Response->Status = HttpStatusOk;
+    AddValidatorHeaders(Response, FileVersion, ShouldInject, Encoding, ETag, LastModified);
+    AddHeader(Response, HttpHeaderContentType, ContentType);
+
+    if (InjectionOffset == NoInjectionOffset)
+    {
+        return;
+    }
+
+    // Skript injizieren - gesendet wird in drei Teilen per writev(), ohne die Datei umzukopieren:
+    // Bis einschließlich Sentinel die originale Datei, dann das Skript, dann der Rest der Datei.
+
+    size_t ScriptSize = ClientScriptTag.Size;
+    Response->ContentParts[0] = { Response->Content, 0, InjectionOffset };
+    Response->ContentParts[1] = { ClientScriptTag.Data, 0, ScriptSize };
+    Response->ContentParts[2] = { Response->Content + InjectionOffset, 0, Response->ContentSize - InjectionOffset };
+    Response->NumContentParts = 3;
+    Response->ContentSize    += ScriptSize;
+}
+
+void FreeResponse(response *Response)
+{
+    switch (Response->ContentSource)
+    {
+        case ContentFromBuffer: free(Response->Content);                break;
+        case ContentFromFile:   close(Response->FileFd);                break;
+        case ContentFromCache:  CacheReleaseFile(Response->CacheEntry); break;
+        case ContentFromStatic:                                         break;
+    }
+
+    // Kopf und alles andere aus der Arena auf einmal, was der Request davor angelegt hat, bleibt
+    if (Response->Arena != NULL) Response->Arena->Size = Response->ArenaMark;
+
+    *Response = {};
+}
+
+//
+// Verbindungen
+//
+
+const size_t RequestBufferSize = 8192;
+const size_t RequestArenaSize  = 16 * 1024;  // Response-Kopf plus Kleinkram, reicht auch für MaxRanges Multipart-Köpfe
+const size_t SendfileChunkSize = 1024 * 1024;  // Höchstens so viel pro sendfile()-Aufruf
+const int    MaxEpollEvents    = 64;
+const int    IdleSweepInterval = 1000;  // Millisekunden
+const int    WriteStallTimeout = 30;    // Sekunden, die eine Response ohne Fortschritt beim Senden hängen darf
+
+const int    WebSocketPingInterval = 30;               // Sekunden ohne Lebenszeichen bis zum Ping
+const size_t MaxWebSocketOutput    = 1024 * 1024;      // Liest ein Client nicht mehr, wird er geschlossen
+
+
+enum connection_state
+{
+    ConnectionReading,    // Wartet auf (den Rest von) einem Request
+    ConnectionWriting,    // Sendet die Response
+    ConnectionWebSocket,  // Nach dem Upgrade, RFC 6455
+};
+
+struct connection
+{
+    int              Fd;
+    connection_state State;
+
+    // Alle Verbindungen einer Event-Loop, für das Schließen inaktiver Verbindungen
+    connection *Prev;
+    connection *Next;
+    uint64_t    LastActivity;  // GetMonotonicMs()
+
+    // Bei Pipelining können hier bereits die nächsten Requests hinter dem aktuellen stehen.
+    char        RequestBuffer[RequestBufferSize];
+    size_t      RequestSize;
+    http_parser Parser;
+    request     Request;      // Zeigt in den RequestBuffer
+    int         NumRequests;  // Anzahl bisher beantworteter Requests
+    bool        KeepAlive;    // Verbindung nach der aktuellen Response offen lassen?
+    bool        OmitContent;  // HEAD-Request: nur den Kopf senden
+
+    response      Response;
+    request_arena Arena;  // Für Request und Response, siehe BeginResponse()
+    char          ArenaMemory[RequestArenaSize];
+    size_t        BytesWritten;  // Zählt über Response.Head und den Inhalt hinweg
+
+    // WebSocket: eingehende Frames landen im RequestBuffer, ausgehende in WebSocketOutput
+    bool        UpgradeToWebSocket;      // Die aktuelle Response ist "101 Switching Protocols"
+    uint64_t    ClientId;                // Für die Client-Registry, 0 = kein WebSocket
+    text_buffer WebSocketOutput;         // NOTE: free()
+    size_t      WebSocketOutputWritten;
+    bool        WebSocketPingSent;
+    bool        WebSocketClosing;        // Close-Frame eingereiht, nach dem Senden schließen
+};
+
+// Nachricht eines anderen Threads an eine WebSocket-Verbindung dieser Event-Loop
+struct websocket_message
+{
+    websocket_message *Next;
+    uint64_t           ClientId;
+    char              *Data;  // NOTE: free()
+    size_t             Size;
+};
+
+struct event_loop
+{
+    int         ServerFd;
+    int         EpollFd;
+    connection *FirstConnection;
+
+    // Verbindungen gehören ihrem Worker, andere Threads legen Nachrichten hier ab und wecken ihn per eventfd
+    int                WakeFd;
+    pthread_mutex_t    OutboxMutex;
+    websocket_message *FirstOutboxMessage;
+    websocket_message *LastOutboxMessage;
+};
+
+uint64_t NextWebSocketClientId = 1;  // NOTE: __atomic
+
+enum io_result { IoDone, IoWouldBlock, IoFailed };
+
+// Liest, bis der Parser einen vollständigen (oder ungültigen) Request im Buffer gefunden hat
+io_result ReadRequest(connection *Connection)
+{
+    for (;;)
+    {
+        http_parse_result ParseResult = ParseRequest(
+            &Connection->Parser,
+            &Connection->Request,
+            &Connection->Arena,
+            Connection->RequestBuffer,
+            Connection->RequestSize,
+            RequestBufferSize);
+
+        if (ParseResult != ParseIncomplete)
+        {
+            return IoDone;
+        }
+
+        ssize_t BytesRead = read(
+            Connection->Fd,
+            &Connection->RequestBuffer[Connection->RequestSize],
+            RequestBufferSize - Connection->RequestSize);
+
+        if (BytesRead > 0)
+        {
+            Connection->LastActivity = GetMonotonicMs();
+            Connection->RequestSize += BytesRead;
+            continue;
+        }
+
+        if (BytesRead == 0)
+        {
+            // Client hat die Verbindung geschlossen
+            return IoFailed;
+        }
+
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return IoWouldBlock;
+
+        PrintError("ReadRequest: read() Fehler");
+        return IoFailed;
+    }
+}
+
+// HTTP/1.1 hält die Verbindung standardmäßig offen, HTTP/1.0 nur mit "Connection: keep-alive"
+bool ShouldKeepAlive(connection *Connection)
+{
+    if (Connection->NumRequests + 1 >= MaxRequestsPerConnection)
+    {
+        return false;
+    }
+
+    const str *ConnectionHeader = FindHeader(&Connection->Request, "Connection");
+    if (HeaderHasToken(ConnectionHeader, "close"))      return false;
+    if (HeaderHasToken(ConnectionHeader, "keep-alive")) return true;
+
+    return Connection->Request.VersionMinor >= 1;
+}
+
+void PrepareErrorResponse(response *Response, const char *Status)
+{
+    Response->Status = Status;
+    AddHeader(Response, HttpHeaderContentType, "text/plain");
+
+    Response->ContentSource = ContentFromStatic;
+    Response->Content       = (char *)Status;
+    Response->ContentSize   = strlen(Status);
+}
+
+// Handshake nach RFC 6455, 4.2. Bei Erfolg wird die Verbindung nach dem Senden der 101-Response
+// zur WebSocket-Verbindung, siehe StartWebSocket().
+void PrepareWebSocketUpgrade(connection *Connection)
+{
+    request  *Request  = &Connection->Request;
+    response *Response = &Connection->Response;
+
+    const str *Key     = FindHeader(Request, "Sec-WebSocket-Key");
+    const str *Version = FindHeader(Request, "Sec-WebSocket-Version");
+    if (!StrEquals(Request->Method, "GET") ||
+        !HeaderHasToken(FindHeader(Request, "Upgrade"), "websocket") ||
+        !HeaderHasToken(FindHeader(Request, "Connection"), "Upgrade") ||
+        Key == NULL || Key->Size != 24)  // Base64 von 16 Bytes
+    {
+        PrintError("PrepareWebSocketUpgrade: Ungültiger Handshake");
+        PrepareErrorResponse(Response, HttpStatusBadRequest);
+        return;
+    }
+
+    if (Version == NULL || !StrEquals(*Version, "13"))
+    {
+        PrepareErrorResponse(Response, HttpStatusUpgradeRequired);
+        AddHeader(Response, "Sec-WebSocket-Version", "13");
+        return;
+    }
+
+    char KeyAndGuid[64];
+    int KeyAndGuidSize = snprintf(KeyAndGuid, sizeof(KeyAndGuid), "%.*s%s", STR_FMT(*Key), WebSocketGuid);
+
+    unsigned char Digest[Sha1DigestSize];
+    HashSha1(KeyAndGuid, KeyAndGuidSize, Digest);
+    char Accept[32];
+    EncodeBase64(Digest, sizeof(Digest), Accept);
+
+    Response->Status = HttpStatusSwitchingProtocols;
+    AddHeader(Response, "Upgrade", "websocket");
+    AddHeader(Response, "Sec-WebSocket-Accept", "%s", Accept);
+
+    Response->ContentSource = ContentFromStatic;
+    Response->Content       = (char *)"";
+    Response->ContentSize   = 0;
+
+    Connection->UpgradeToWebSocket = true;
+    Connection->KeepAlive          = true;
+    Connection->OmitContent        = false;
+}
+
+void PrepareResponse(connection *Connection)
+{
+    request  *Request  = &Connection->Request;
+    response *Response = &Connection->Response;
+
+    BeginResponse(Response, &Connection->Arena);
+
+    if (Connection->Parser.ErrorStatus != NULL)
+    {
+        // Ungültiger Request - wo der nächste anfängt, weiß hier keiner mehr, also Verbindung schließen
+        PrintError("PrepareResponse: Ungültiger Request (%s)", Connection->Parser.ErrorStatus);
+
+        Connection->KeepAlive   = false;
+        Connection->OmitContent = false;
+        PrepareErrorResponse(Response, Connection->Parser.ErrorStatus);
+    }
+    else
+    {
+        if (RequestLoggingEnabled)
+        {
+            printf(
+                "\nRequest: Method='%.*s'; Path='%.*s'; Query='%.*s'; HTTP/1.%d\n",
+                STR_FMT(Request->Method),
+                STR_FMT(Request->Path),
+                STR_FMT(Request->Query),
+                Request->VersionMinor);
+
+            for (int I = 0; I < Request->NumHeaders; ++I)
+            {
+                printf("%.*s: %.*s\n", STR_FMT(Request->Headers[I].Name), STR_FMT(Request->Headers[I].Value));
+            }
+        }
+
+        Connection->KeepAlive   = ShouldKeepAlive(Connection);
+        Connection->OmitContent = StrEquals(Request->Method, "HEAD");
+        if (StrEquals(Request->Path, WebSocketPath) && FindHeader(Request, "Upgrade") != NULL)
+        {
+            PrepareWebSocketUpgrade(Connection);
+        }
+        else if (StrEquals(Request->Path, ClientScriptPath))
+        {
+            HandleClientScriptRequest(Request, Response);
+        }
+        else
+        {
+            HandleRequest(Request, Response);
+        }
+    }
+
+
+    assert(Response->Status != NULL);
+    assert(Response->ContentSource == ContentFromFile || Response->Content != NULL);
+
+    if (Response->NumContentParts == 0)
+    {
+        Response->ContentParts[0] = { Response->Content, 0, Response->ContentSize };
+        Response->NumContentParts = 1;
+    }
+
+    AddHeader(Response, "Access-Control-Allow-Origin", "*");
+    if (Connection->UpgradeToWebSocket)
+    {
+        // Kein Inhalt, danach gehört die Verbindung dem WebSocket-Protokoll
+        AddHeader(Response, "Connection", "Upgrade");
+    }
+    else
+    {
+        // Bei 304 stünde hier die Länge der nicht gesendeten 200-Response, also lieber gar nichts
+        if (Response->Status != HttpStatusNotModified)
+        {
+            AddHeader(Response, "Content-Length", "%llu", (unsigned long long)Response->ContentSize);
+        }
+
+        if (Connection->KeepAlive)
+        {
+            AddHeader(Response, "Connection", "keep-alive");
+            AddHeader(Response, "Keep-Alive", "timeout=%d, max=%d", KeepAliveTimeout, MaxRequestsPerConnection - Connection->NumRequests - 1);
+        }
+        else
+        {
+            AddHeader(Response, "Connection", "close");
+        }
+    }
+
+    // Die Header stehen schon fertig im Kopf, gesendet wird später in WriteResponse()
+    if (!FinishResponseHead(Response))
+    {
+        // Ohne z.B. Content-Length wüsste der Client nicht, wo die nächste Response anfängt.
+        // Also alles verwerfen, stattdessen eine 500 ohne Extras und danach schließen.
+        FreeResponse(Response);
+        BeginResponse(Response, &Connection->Arena);
+
+        Connection->KeepAlive          = false;
+        Connection->UpgradeToWebSocket = false;
+        PrepareErrorResponse(Response, HttpStatusInternalError);
+        Response->ContentParts[0] = { Response->Content, 0, Response->ContentSize };
+        Response->NumContentParts = 1;
+
+        AddHeader(Response, "Content-Length", "%llu", (unsigned long long)Response->ContentSize);
+        AddHeader(Response, "Connection", "close");
+
+        FinishResponseHead(Response);  // Passt immer, der Kopf ist sonst leer
+    }
+
+    Connection->BytesWritten = 0;
+
+    if (ResponseLoggingEnabled)
+    {
+        printf("\nResponse:\n%.*s\n", (int)(Response->HeadSize - Response->HeadStart), Response->Head + Response->HeadStart);
+    }
+}
+
+io_result WriteResponse(connection *Connection)
+{
+    response *Response  = &Connection->Response;
+    char     *Head      = Response->Head + Response->HeadStart;
+    size_t    HeadSize  = Response->HeadSize - Response->HeadStart;
+    size_t    TotalSize = HeadSize + (Connection->OmitContent ? 0 : Response->ContentSize);
+
+    while (Connection->BytesWritten < TotalSize)
+    {
+        // Den Part suchen, in dem es weitergeht, der Kopf zählt als Part -1
+        int    Part = -1;
+        size_t Skip = Connection->BytesWritten;
+        if (Skip >= HeadSize)
+        {
+            Skip -= HeadSize;
+            for (Part = 0; Skip >= Response->ContentParts[Part].Size; ++Part) Skip -= Response->ContentParts[Part].Size;
+        }
+
+        ssize_t Written;
+        if (Part >= 0 && Response->ContentParts[Part].Data == NULL)
+        {
+            off_t  Offset = Response->ContentParts[Part].FileOffset + Skip;
+            size_t Size   = Response->ContentParts[Part].Size - Skip;
+            if (Size > SendfileChunkSize) Size = SendfileChunkSize;
+            Written = sendfile(Connection->Fd, Response->FileFd, &Offset, Size);
+
+            if (Written == 0)
+            {
+                // Die Datei ist beim Senden kürzer geworden, Content-Length stimmt nicht mehr
+                PrintError("WriteResponse: Datei wurde während des Sendens abgeschnitten");
+                return IoFailed;
+            }
+        }
+        else
+        {
+            // Kopf und alle Parts aus dem Speicher bis zum nächsten Datei-Part mit einem writev(),
+            // dabei alles überspringen, was schon gesendet wurde
+            iovec Parts[1 + MaxContentParts];
+            int   NumParts = 0;
+            if (Part == -1)
+            {
+                Parts[NumParts++] = { Head + Skip, HeadSize - Skip };
+                Part = 0;
+                Skip = 0;
+            }
+
+            for (int I = Part; !Connection->OmitContent && I < Response->NumContentParts && Response->ContentParts[I].Data != NULL; ++I)
+            {
+                Parts[NumParts++] = { (char *)Response->ContentParts[I].Data + Skip, Response->ContentParts[I].Size - Skip };
+                Skip = 0;
+            }
+
+            Written = writev(Connection->Fd, Parts, NumParts);
+        }
+
+        if (Written >= 0)
+        {
+            Connection->LastActivity = GetMonotonicMs();
+            Connection->BytesWritten += Written;
+            continue;
+        }
+
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return IoWouldBlock;
+
+        PrintError("WriteResponse: writev()/sendfile() Fehler");
+        return IoFailed;
+    }
+
+    return IoDone;
+}
+
+// Bereitet die Verbindung nach einer gesendeten Response auf den nächsten Request vor.
+// Bereits gelesene (gepipelinete) Requests werden an den Anfang des Buffers geschoben.
+void FinishRequest(connection *Connection)
+{
+    FreeResponse(&Connection->Response);
+    Connection->Arena.Size = 0;
+
+    size_t RequestEnd = Connection->Parser.Position;
+    size_t Remaining  = Connection->RequestSize - RequestEnd;
+    memmove(Connection->RequestBuffer, &Connection->RequestBuffer[RequestEnd], Remaining);
+
+    Connection->RequestSize      = Remaining;
+    Connection->Parser           = {};
+    Connection->Request          = {};
+    Connection->BytesWritten     = 0;
+    Connection->NumRequests     += 1;
+    Connection->State            = ConnectionReading;
+    Connection->UpgradeToWebSocket = false;
+}
+
+void CloseConnection(event_loop *Loop, connection *Connection)
+{
+    if (Connection->Prev != NULL) Connection->Prev->Next = Connection->Next;
+    else                          Loop->FirstConnection  = Connection->Next;
+    if (Connection->Next != NULL) Connection->Next->Prev = Connection->Prev;
+
+    if (Connection->ClientId != 0)
+    {
+        printf("WebSocket-Verbindung %llu geschlossen\n", (unsigned long long)Connection->ClientId);
+        RemoveClient(Connection->ClientId);
+    }
+
+    // close() entfernt den Socket auch aus dem epoll-Set
+    close(Connection->Fd);
+    FreeResponse(&Connection->Response);
+    free(Connection->WebSocketOutput.Data);
+    free(Connection);
+}
+
+enum websocket_opcode
+{
+    WebSocketContinuation = 0x0,
+    WebSocketText         = 0x1,
+    WebSocketBinary       = 0x2,
+    WebSocketClose        = 0x8,
+    WebSocketPing         = 0x9,
+    WebSocketPong         = 0xA,
+};
+
+// Hängt einen Frame an WebSocketOutput an, gesendet wird mit WriteWebSocketOutput().
+// Server-Frames sind nie maskiert und nie fragmentiert. false, wenn der Client nicht mehr liest.
+bool QueueWebSocketFrame(connection *Connection, websocket_opcode Opcode, const void *Payload, size_t Size)
+{
+    if (Connection->WebSocketClosing)
+    {
+        // Nach dem Close-Frame darf nichts mehr kommen
+        return true;
+    }
+
+    size_t Pending = Connection->WebSocketOutput.Size - Connection->WebSocketOutputWritten;
+    if (Opcode != WebSocketClose && Pending + Size > MaxWebSocketOutput)
+    {
+        return false;
+    }
+
+    unsigned char Header[10];
+    size_t HeaderSize = 0;
+    Header[HeaderSize++] = 0x80 | Opcode;  // FIN
+    if (Size < 126)
+    {
+        Header[HeaderSize++] = (unsigned char)Size;
+    }
+    else if (Size <= 0xFFFF)
+    {
+        Header[HeaderSize++] = 126;
+        Header[HeaderSize++] = (unsigned char)(Size >> 8);
+        Header[HeaderSize++] = (unsigned char)Size;
+    }
+    else
+    {
+        Header[HeaderSize++] = 127;
+        for (int I = 7; I >= 0; --I) Header[HeaderSize++] = (unsigned char)((uint64_t)Size >> (I * 8));
+    }
+
+    TextAppend(&Connection->WebSocketOutput, (const char *)Header, HeaderSize);
+    TextAppend(&Connection->WebSocketOutput, (const char *)Payload, Size);
+
+    if (Opcode == WebSocketClose)
+    {
+        Connection->WebSocketClosing = true;
+    }
+
+    return true;
+}
+
+// Status Codes nach RFC 6455, 7.4.1
+void QueueWebSocketClose(connection *Connection, uint16_t StatusCode)
+{
+    unsigned char Payload[2] = { (unsigned char)(StatusCode >> 8), (unsigned char)StatusCode };
+    QueueWebSocketFrame(Connection, WebSocketClose, Payload, sizeof(Payload));
+}
+
+io_result WriteWebSocketOutput(connection *Connection)
+{
+    text_buffer *Output = &Connection->WebSocketOutput;
+    while (Connection->WebSocketOutputWritten < Output->Size)
+    {
+        ssize_t Written = write(
+            Connection->Fd,
+            Output->Data + Connection->WebSocketOutputWritten,
+            Output->Size - Connection->WebSocketOutputWritten);
+
+        if (Written >= 0)
+        {
+            Connection->WebSocketOutputWritten += Written;
+            continue;
+        }
+
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return IoWouldBlock;
+
+        PrintError("WriteWebSocketOutput: write() Fehler");
+        return IoFailed;
+    }
+
+    // Alles raus, der Speicher wird für die nächsten Frames wiederverwendet
+    Output->Size = 0;
+    Connection->WebSocketOutputWritten = 0;
+    return IoDone;
+}
+
+// Verarbeitet alle vollständigen Frames im RequestBuffer und schiebt den Rest an den Anfang.
+// Ein Frame passt immer komplett in den Buffer, größere werden abgelehnt.
+void HandleWebSocketFrames(connection *Connection)
+{
+    unsigned char *Buffer   = (unsigned char *)Connection->RequestBuffer;
+    size_t         Position = 0;
+
+    while (!Connection->WebSocketClosing)
+    {
+        unsigned char *Frame     = Buffer + Position;
+        size_t         Available = Connection->RequestSize - Position;
+        if (Available < 2) break;
+
+        bool     IsFinal     = (Frame[0] & 0x80) != 0;
+        int      Opcode      = Frame[0] & 0x0F;
+        bool     IsMasked    = (Frame[1] & 0x80) != 0;
+        uint64_t PayloadSize = Frame[1] & 0x7F;
+        size_t   HeaderSize  = 2;
+        if (PayloadSize == 126)
+        {
+            if (Available < 4) break;
+            PayloadSize = ((uint64_t)Frame[2] << 8) | Frame[3];
+            HeaderSize  = 4;
+        }
+        else if (PayloadSize == 127)
+        {
+            if (Available < 10) break;
+            PayloadSize = 0;
+            for (int I = 2; I < 10; ++I) PayloadSize = (PayloadSize << 8) | Frame[I];
+            HeaderSize = 10;
+        }
+
+        // Ohne ausgehandelte Erweiterungen müssen die RSV-Bits 0 sein, Client-Frames sind immer maskiert
+        // und Control Frames kurz und unfragmentiert (RFC 6455, 5.2 und 5.5)
+        bool IsControl     = (Opcode & 0x8) != 0;
+        bool IsKnownOpcode = Opcode <= WebSocketBinary || (Opcode >= WebSocketClose && Opcode <= WebSocketPong);
+        if ((Frame[0] & 0x70) != 0 || !IsMasked || !IsKnownOpcode || (IsControl && (!IsFinal || PayloadSize > 125)))
+        {
+            PrintError("HandleWebSocketFrames: Ungültiger Frame von Client %llu", (unsigned long long)Connection->ClientId);
+            QueueWebSocketClose(Connection, 1002);
+            break;
+        }
+
+        // Das Skript schickt nur den Pfad seiner Seite, fragmentierte Nachrichten kommen nicht vor
+        if (!IsFinal || Opcode == WebSocketContinuation)
+        {
+            QueueWebSocketClose(Connection, 1003);
+            break;
+        }
+
+        if (PayloadSize > RequestBufferSize - HeaderSize - 4)
+        {
+            QueueWebSocketClose(Connection, 1009);
+            break;
+        }
+
+        size_t FrameSize = HeaderSize + 4 + PayloadSize;
+        if (Available < FrameSize) break;
+
+        unsigned char *Mask    = Frame + HeaderSize;
+        unsigned char *Payload = Mask + 4;
+        for (size_t I = 0; I < PayloadSize; ++I) Payload[I] ^= Mask[I % 4];
+
+        switch (Opcode)
+        {
+            // Die einzige Nachricht vom Client ist der Pfad seiner Seite direkt nach dem Verbinden
+            case WebSocketText:  SubscribeClient(Connection->ClientId, { (const char *)Payload, PayloadSize }); break;
+            case WebSocketPing:  QueueWebSocketFrame(Connection, WebSocketPong, Payload, PayloadSize);         break;
+            case WebSocketClose: QueueWebSocketFrame(Connection, WebSocketClose, Payload, PayloadSize >= 2 ? 2 : 0); break;
+            default:             break;
+        }
+
+        Position += FrameSize;
+    }
+
+    memmove(Buffer, Buffer + Position, Connection->RequestSize - Position);
+    Connection->RequestSize -= Position;
+}
+
+// Liest und verarbeitet Frames, bis der Socket EAGAIN meldet oder die Verbindung geschlossen wird
+io_result ReadWebSocketFrames(connection *Connection)
+{
+    for (;;)
+    {
+        HandleWebSocketFrames(Connection);
+        if (Connection->WebSocketClosing)
+        {
+            return IoDone;
+        }
+
+        ssize_t BytesRead = read(
+            Connection->Fd,
+            &Connection->RequestBuffer[Connection->RequestSize],
+            RequestBufferSize - Connection->RequestSize);
+
+        if (BytesRead > 0)
+        {
+            Connection->LastActivity      = GetMonotonicMs();
+            Connection->WebSocketPingSent = false;
+            Connection->RequestSize      += BytesRead;
+            continue;
+        }
+
+        if (BytesRead == 0)
+        {
+            return IoFailed;
+        }
+
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return IoWouldBlock;
+
+        PrintError("ReadWebSocketFrames: read() Fehler");
+        return IoFailed;
+    }
+}
+
+// Nach der 101-Response: ab jetzt spricht die Verbindung WebSocket und bekommt Benachrichtigungen
+void StartWebSocket(event_loop *Loop, connection *Connection)
+{
+    Connection->State        = ConnectionWebSocket;
+    Connection->ClientId     = __atomic_fetch_add(&NextWebSocketClientId, 1, __ATOMIC_RELAXED);
+    Connection->LastActivity = GetMonotonicMs();
+
+    char Address[INET6_ADDRSTRLEN] = "?";
+    sockaddr_in PeerAddress{};
+    socklen_t PeerAddressSize = sizeof(PeerAddress);
+    if (getpeername(Connection->Fd, (sockaddr *)&PeerAddress, &PeerAddressSize) == 0)
+    {
+        inet_ntop(AF_INET, &PeerAddress.sin_addr, Address, sizeof(Address));
+    }
+
+    printf("WebSocket-Verbindung %llu hergestellt: %s\n", (unsigned long long)Connection->ClientId, Address);
+    AddClient(Connection->ClientId, Loop);
+}
+
+void HandleWebSocketEvent(event_loop *Loop, connection *Connection)
+{
+    if (ReadWebSocketFrames(Connection) == IoFailed)
+    {
+        CloseConnection(Loop, Connection);
+        return;
+    }
+
+    switch (WriteWebSocketOutput(Connection))
+    {
+        case IoWouldBlock: return;
+        case IoFailed:     CloseConnection(Loop, Connection); return;
+        case IoDone:       break;
+    }
+
+    if (Connection->WebSocketClosing)
+    {
+        CloseConnection(Loop, Connection);
+    }
+}
+
+// Thread-sicher, übernimmt Data. Der Worker der Event-Loop sendet die Nachricht als Text-Frame.
+void PostWebSocketMessage(event_loop *Loop, uint64_t ClientId, char *Data, size_t Size)
+{
+    websocket_message *Message = (websocket_message *)malloc(sizeof(websocket_message));
+    *Message = { NULL, ClientId, Data, Size };
+
+    pthread_mutex_lock(&Loop->OutboxMutex);
+
+    bool WasEmpty = Loop->FirstOutboxMessage == NULL;
+    if (WasEmpty) Loop->FirstOutboxMessage      = Message;
+    else          Loop->LastOutboxMessage->Next = Message;
+    Loop->LastOutboxMessage = Message;
+
+    pthread_mutex_unlock(&Loop->OutboxMutex);
+
+    // Bei einer nicht leeren Outbox ist der Worker schon geweckt
+    if (WasEmpty)
+    {
+        uint64_t One = 1;
+        write(Loop->WakeFd, &One, sizeof(One));
+    }
+}
+
+connection *FindWebSocketConnection(event_loop *Loop, uint64_t ClientId)
+{
+    for (connection *Connection = Loop->FirstConnection; Connection != NULL; Connection = Connection->Next)
+    {
+        if (Connection->ClientId == ClientId) return Connection;
+    }
+
+    return NULL;
+}
+
+// Läuft im Worker, wenn WakeFd signalisiert
+void DeliverWebSocketMessages(event_loop *Loop)
+{
+    uint64_t Counter;
+    read(Loop->WakeFd, &Counter, sizeof(Counter));
+
+    pthread_mutex_lock(&Loop->OutboxMutex);
+    websocket_message *Message = Loop->FirstOutboxMessage;
+    Loop->FirstOutboxMessage = NULL;
+    Loop->LastOutboxMessage  = NULL;
+    pthread_mutex_unlock(&Loop->OutboxMutex);
+
+    while (Message != NULL)
+    {
+        // Die Verbindung kann inzwischen geschlossen sein
+        connection *Connection = FindWebSocketConnection(Loop, Message->ClientId);
+        if (Connection != NULL && !QueueWebSocketFrame(Connection, WebSocketText, Message->Data, Message->Size))
+        {
+            PrintError("WebSocket-Client %llu liest nicht mehr, schließe die Verbindung", (unsigned long long)Connection->ClientId);
+            CloseConnection(Loop, Connection);
+        }
+        else if (Connection != NULL && WriteWebSocketOutput(Connection) == IoFailed)
+        {
+            CloseConnection(Loop, Connection);
+        }
+
+        websocket_message *Next = Message->Next;
+        free(Message->Data);
+        free(Message);
+        Message = Next;
+    }
+}
+
+// Schließt Verbindungen, die länger als KeepAliveTimeout auf einen Request warten oder deren Response seit
+// WriteStallTimeout nicht weiterkommt, weil der Client nicht mehr liest (sonst blieben Socket, FileFd und
+// Cache-Referenz für immer belegt). WebSocket-Verbindungen bekommen nach WebSocketPingInterval einen Ping;
+// kommt bis zum nächsten Intervall nichts, ist der Client weg.
+void CloseIdleConnections(event_loop *Loop)
+{
+    uint64_t Now = GetMonotonicMs();
+    for (connection *Connection = Loop->FirstConnection; Connection != NULL;)
+    {
+        connection *Next = Connection->Next;
+
+        bool IsIdle = Connection->State == ConnectionReading && Now - Connection->LastActivity >= (uint64_t)KeepAliveTimeout * 1000;
+        if (Connection->State == ConnectionWriting && Now - Connection->LastActivity >= (uint64_t)WriteStallTimeout * 1000)
+        {
+            PrintError("CloseIdleConnections: Client liest die Response seit %d Sekunden nicht weiter", WriteStallTimeout);
+            IsIdle = true;
+        }
+
+        if (Connection->State == ConnectionWebSocket && Now - Connection->LastActivity >= (uint64_t)WebSocketPingInterval * 1000)
+        {
+            if (!Connection->WebSocketPingSent)
+            {
+                Connection->WebSocketPingSent = true;
+                IsIdle = !QueueWebSocketFrame(Connection, WebSocketPing, "", 0) || WriteWebSocketOutput(Connection) == IoFailed;
+            }
+            else
+            {
+                IsIdle = Now - Connection->LastActivity >= (uint64_t)WebSocketPingInterval * 2000;
+            }
+        }
+
+        if (IsIdle)
+        {
+            CloseConnection(Loop, Connection);
+        }
+
+        Connection = Next;
+    }
+}
+
+// Wird bei jedem epoll-Event für die Verbindung aufgerufen. Da edge-triggered, muss hier
+// jeweils so lange gelesen bzw. geschrieben werden, bis der Socket EAGAIN meldet.
+void HandleConnectionEvent(event_loop *Loop, connection *Connection, uint32_t Events)
+{
+    if (Events & EPOLLERR)
+    {
+        CloseConnection(Loop, Connection);
+        return;
+    }
+
+    for (;;)
+    {
+        if (Connection->State == ConnectionWebSocket)
+        {
+            HandleWebSocketEvent(Loop, Connection);
+            return;
+        }
+
+        if (Connection->State == ConnectionReading)
+        {
+            switch (ReadRequest(Connection))
+            {
+                case IoWouldBlock: return;
+                case IoFailed:     CloseConnection(Loop, Connection); return;
+                case IoDone:       break;
+            }
+
+            PrepareResponse(Connection);
+            Connection->State = ConnectionWriting;
+        }
+
+        if (Connection->State == ConnectionWriting)
+        {
+            switch (WriteResponse(Connection))
+            {
+                case IoWouldBlock: return;
+                case IoFailed:     CloseConnection(Loop, Connection); return;
+                case IoDone:       break;
+            }
+
+            if (!Connection->KeepAlive)
+            {
+                // Noch ungelesene Daten verwerfen, sonst schickt der Kernel beim close() ein RST
+                // und der Client bekommt die (Fehler-)Response evtl. gar nicht zu sehen.
+                shutdown(Connection->Fd, SHUT_WR);
+                for (int I = 0; I < 8 && read(Connection->Fd, Connection->RequestBuffer, RequestBufferSize) > 0; ++I) {}
+
+                CloseConnection(Loop, Connection);
+                return;
+            }
+
+            // Weiter mit dem nächsten Request, der evtl. schon im Buffer steht. Nach einem Upgrade
+            // sind das bereits die ersten WebSocket-Frames.
+            bool IsUpgrade = Connection->UpgradeToWebSocket;
+            FinishRequest(Connection);
+            if (IsUpgrade)
+            {
+                StartWebSocket(Loop, Connection);
+            }
+        }
+    }
+}
+
+void AcceptConnections(event_loop *Loop)
+{
+    for (;;)
+    {
+        int ClientFd = accept4(Loop->ServerFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (ClientFd == -1)
+        {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+
+            PrintError("Fehler beim Annehmen des Clients, weiter geht's");
+            return;
+        }
+
+        // Kopf und Inhalt werden getrennt geschrieben, Nagle würde bei Keep-Alive die
+        // zweite Hälfte bis zum (verzögerten) ACK des Clients zurückhalten.
+        int TcpNoDelay = 1;
+        setsockopt(ClientFd, IPPROTO_TCP, TCP_NODELAY, &TcpNoDelay, sizeof(int));
+
+        connection *Connection = (connection *)calloc(1, sizeof(connection));
+        Connection->Fd           = ClientFd;
+        Connection->State        = ConnectionReading;
+        Connection->LastActivity = GetMonotonicMs();
+        Connection->Arena        = { Connection->ArenaMemory, 0, sizeof(Connection->ArenaMemory) };
+
+        Connection->Next = Loop->FirstConnection;
+        if (Loop->FirstConnection != NULL) Loop->FirstConnection->Prev = Connection;
+        Loop->FirstConnection = Connection;
+
+        // Lesen und Schreiben werden einmalig registriert, der Zustand der Verbindung entscheidet,
+        // was bei einem Event passiert.
+        epoll_event Event{};
+        Event.events   = EPOLLIN | EPOLLOUT | EPOLLET;
+        Event.data.ptr = Connection;
+        if (epoll_ctl(Loop->EpollFd, EPOLL_CTL_ADD, ClientFd, &Event) != 0)
+        {
+            PrintError("AcceptConnections: epoll_ctl() fehlgeschlagen");
+            CloseConnection(Loop, Connection);
+        }
+    }
+}
+
+//
+// Worker
+//
+
+// Jeder Worker hat einen eigenen Server-Socket (SO_REUSEPORT) und eine eigene Event-Loop.
+// Der Kernel verteilt neue Verbindungen auf die Sockets, Verbindungen wechseln danach nie den Thread.
+struct worker
+{
+    int        Index;
+    pthread_t  ThreadId;
+    bool       ThreadStarted;
+    event_loop Loop;
+};
+
+worker *Workers = NULL;
+
+int OpenServerSocket()
+{
+    int ServerFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ServerFd == -1)
+    {
+        PrintError("Fehler beim Öffnen des Sockets");
+        return -1;
+    }
+
+    int SoReuseAddr = 1;
+    if (setsockopt(ServerFd, SOL_SOCKET, SO_REUSEADDR, &SoReuseAddr, sizeof(int)) < 0)
+    {
+        PrintError("Fehler beim Konfigurieren des Sockets");
+        close(ServerFd);
+        return -1;
+    }
+
+    // Nur mit mehreren Workern, sonst könnte eine zweite LiveGate-Instanz unbemerkt denselben Port belegen
+    int SoReusePort = 1;
+    if (NumWorkers > 1 && setsockopt(ServerFd, SOL_SOCKET, SO_REUSEPORT, &SoReusePort, sizeof(int)) < 0)
+    {
+        PrintError("Fehler beim Konfigurieren des Sockets (SO_REUSEPORT)");
+        close(ServerFd);
+        return -1;
+    }
+
+    sockaddr_in ServerAddress{};
+    ServerAddress.sin_family      = AF_INET;
+    ServerAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+    ServerAddress.sin_port        = htons(Port);
+
+    int BindResult = bind(ServerFd, (sockaddr *)&ServerAddress, sizeof(ServerAddress));
+    if (BindResult != 0)
+    {
+        PrintError("Fehler beim Binden des Sockets");
+        close(ServerFd);
+        return -1;
+    }
+
+    int ListenResult = listen(ServerFd, SOMAXCONN);
+    if (ListenResult != 0)
+    {
+        PrintError("Fehler beim Binden des Sockets");
+        close(ServerFd);
+        return -1;
+    }
+
+    return ServerFd;
+}
+
+void RunEventLoop(event_loop *Loop)
+{
+    defer
+    {
+        while (Loop->FirstConnection != NULL) CloseConnection(Loop, Loop->FirstConnection);
+    };
+
+    // Der Server-Socket wird an data.ptr == NULL erkannt, WakeFd an data.ptr == Loop,
+    // alle anderen Events gehören zu einer connection
+    epoll_event ServerEvent{};
+    ServerEvent.events   = EPOLLIN | EPOLLET;
+    ServerEvent.data.ptr = NULL;
+    if (epoll_ctl(Loop->EpollFd, EPOLL_CTL_ADD, Loop->ServerFd, &ServerEvent) != 0)
+    {
+        PrintError("Fehler beim Registrieren des Sockets bei epoll");
+        return;
+    }
+
+    epoll_event WakeEvent{};
+    WakeEvent.events   = EPOLLIN | EPOLLET;
+    WakeEvent.data.ptr = Loop;
+    if (epoll_ctl(Loop->EpollFd, EPOLL_CTL_ADD, Loop->WakeFd, &WakeEvent) != 0)
+    {
+        PrintError("Fehler beim Registrieren des eventfd bei epoll");
+        return;
+    }
+
+    epoll_event Events[MaxEpollEvents];
+    uint64_t LastIdleSweep = GetMonotonicMs();
+    for (;;)
+    {
+        int NumEvents = epoll_wait(Loop->EpollFd, Events, MaxEpollEvents, IdleSweepInterval);
+        if (NumEvents == -1)
+        {
+            if (errno == EINTR) continue;
+
+            PrintError("epoll_wait() fehlgeschlagen");
+            return;
+        }
+
+        for (int I = 0; I < NumEvents; ++I)
+        {
+            connection *Connection = (connection *)Events[I].data.ptr;
+            if (Connection == NULL)
+            {
+                AcceptConnections(Loop);
+            }
+            else if (Events[I].data.ptr == Loop)
+            {
+                DeliverWebSocketMessages(Loop);
+            }
+            else
+            {
+                HandleConnectionEvent(Loop, Connection, Events[I].events);
+            }
+        }
+
+        if (GetMonotonicMs() - LastIdleSweep >= IdleSweepInterval)
+        {
+            CloseIdleConnections(Loop);
+            LastIdleSweep = GetMonotonicMs();
+        }
+    }
+}
+
+void *WorkerThreadCallback(void *Arg)
+{
+    worker *Worker = (worker *)Arg;
+
+    if (PinWorkersToCpus)
+    {
+        int NumCpus = sysconf(_SC_NPROCESSORS_ONLN);
+        int Cpu     = Worker->Index % (NumCpus > 0 ? NumCpus : 1);
+
+        cpu_set_t CpuSet;
+        CPU_ZERO(&CpuSet);
+        CPU_SET(Cpu, &CpuSet);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(CpuSet), &CpuSet) != 0)
+        {
+            PrintError("Worker %d: Konnte den Thread nicht an CPU %d binden", Worker->Index, Cpu);
+        }
+    }
+
+    RunEventLoop(&Worker->Loop);
+
+    return NULL;
+}
+
+//
+// WebSocket-Clients
+//
+
+// Jede offene Seite (Tab, Handy, ...) hat eine eigene WebSocket-Verbindung. Nach dem Verbinden meldet
+// die Seite ihren Pfad; daraus werden die Seite selbst und ihre Abhängigkeiten (src-Attribute und
+// <link href>) als Pfade relativ zu ContentDir abgeleitet. Änderungen gehen nur an Clients, die von
+// der Datei abhängen. Hängt kein Client von einer Datei ab (z.B. per @import oder fetch() geladen),
+// geht sie an alle, der Client entscheidet dann selbst.
+//
+// Jede Änderung bekommt eine fortlaufende Sequenznummer und landet im ChangeLog. Nach einem
+// Verbindungsabbruch meldet sich die Seite mit Epoche und zuletzt gesehener Nummer neu an und bekommt
+// die verpassten Änderungen nachgeliefert. Die Epoche ändert sich bei jedem Serverstart.
+
+const uint64_t ChangeLogCapacity = 256;
+
+struct live_client
+{
+    uint64_t    ClientId;         // connection::ClientId
+    event_loop *Loop;             // Event-Loop, der die Verbindung gehört
+    char       *PageFile;         // NULL, bis die Seite ihren Pfad gemeldet hat
+    text_buffer Dependencies;     // Jeweils nullterminiert hintereinander
+    size_t      NumDependencies;
+};
+
+struct client_registry
+{
+    pthread_mutex_t Mutex;
+    live_client    *Clients;
+    size_t          NumClients;
+    size_t          Capacity;
+
+    // Ringpuffer, die Änderung mit Sequenznummer Seq liegt bei ChangeLog[Seq % ChangeLogCapacity]
+    notification ChangeLog[ChangeLogCapacity];
+    uint64_t     LastSeq;  // 0 = noch keine Änderung
+};
+
+client_registry ClientRegistry = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, {}, 0 };
+char ServerEpoch[17];  // Hex, siehe InitServerEpoch()
+
+void InitServerEpoch()
+{
+    timespec Now;
+    clock_gettime(CLOCK_REALTIME, &Now);
+    uint64_t Seed[3] = { (uint64_t)Now.tv_sec, (uint64_t)Now.tv_nsec, (uint64_t)getpid() };
+    snprintf(ServerEpoch, sizeof(ServerEpoch), "%016llx", (unsigned long long)HashXx64(Seed, sizeof(Seed)));
+}
+
+// Löst "." und ".." im Pfad auf, Path beginnt mit '/'
+void NormalizeUrlPath(char *Path)
+{
+    char *Out = Path;
+    const char *In = Path;
+    while (*In == '/')
+    {
+        const char *Segment = In + 1;
+        const char *SegmentEnd = strchrnul(Segment, '/');
+        size_t SegmentSize = SegmentEnd - Segment;
+
+        if (SegmentSize == 1 && Segment[0] == '.')
+        {
+            if (*SegmentEnd == '\0') *Out++ = '/';
+        }
+        else if (SegmentSize == 2 && Segment[0] == '.' && Segment[1] == '.')
+        {
+            while (Out > Path && *--Out != '/') {}
+            if (*SegmentEnd == '\0') *Out++ = '/';
+        }
+        else
+        {
+            memmove(Out, In, SegmentEnd - In);
+            Out += SegmentEnd - In;
+        }
+
+        In = SegmentEnd;
+    }
+
+    if (Out == Path) *Out++ = '/';
+    *Out = '\0';
+}
+
+// Macht aus einer URL in der Seite einen Pfad relativ zu ContentDir. false für externe URLs.
+bool ResolvePageUrl(const char *PageFile, str Url, char Output[PATH_MAX])
+{
+    if (Url.Size == 0 || Url.Data[0] == '#' || (Url.Size >= 2 && Url.Data[0] == '/' && Url.Data[1] == '/'))
+    {
+        return false;
+    }
+
+    // Schema wie http:, data:, mailto:
+    for (size_t I = 0; I < Url.Size && Url.Data[I] != '/'; ++I)
+    {
+        if (Url.Data[I] == ':') return false;
+    }
+
+    for (size_t I = 0; I < Url.Size; ++I)
+    {
+        if (Url.Data[I] == '?' || Url.Data[I] == '#')
+        {
+            Url.Size = I;
+            break;
+        }
+    }
+
+    int Size;
+    if (Url.Data[0] == '/')
+    {
+        Size = snprintf(Output, PATH_MAX, "%.*s", STR_FMT(Url));
+    }
+    else
+    {
+        int DirSize = (int)(strrchr(PageFile, '/') - PageFile) + 1;
+        Size = snprintf(Output, PATH_MAX, "%.*s%.*s", DirSize, PageFile, STR_FMT(Url));
+    }
+
+    size_t DecodedSize;
+    if (Size >= PATH_MAX || !PercentDecode(Output, Size, Output, &DecodedSize))
+    {
+        return false;
+    }
+
+    Output[DecodedSize] = '\0';
+    NormalizeUrlPath(Output);
+    return true;
+}
+
+void AddClientDependency(live_client *Client, const char *Path)
+{
+    TextAppend(&Client->Dependencies, Path, strlen(Path) + 1);
+    ++Client->NumDependencies;
+}
+
+// Sammelt src-Attribute aller Tags und href-Attribute von <link>, Links auf andere Seiten (<a href>)
+// sind keine Abhängigkeiten
+void CollectPageDependencies(live_client *Client, const char *Html, size_t Size)
+{
+    const char *End = Html + Size;
+    char Tag[16] = {};
+
+    for (const char *At = Html; At < End; ++At)
+    {
+        if (*At == '<')
+        {
+            size_t TagSize = 0;
+            for (const char *Name = At + 1; Name < End && isalnum((unsigned char)*Name) && TagSize < sizeof(Tag) - 1; ++Name)
+            {
+                Tag[TagSize++] = tolower((unsigned char)*Name);
+            }
+
+            Tag[TagSize] = '\0';
+            continue;
+        }
+
+        if (!isspace((unsigned char)*At))
+        {
+            continue;
+        }
+
+        const char *Name = At + 1;
+        size_t NameSize = 0;
+        if (End - Name > 3 && strncasecmp(Name, "src", 3) == 0) NameSize = 3;
+        else if (End - Name > 4 && strncasecmp(Name, "href", 4) == 0 && strcmp(Tag, "link") == 0) NameSize = 4;
+        if (NameSize == 0)
+        {
+            continue;
+        }
+
+        const char *Value = Name + NameSize;
+        while (Value < End && isspace((unsigned char)*Value)) ++Value;
+        if (Value >= End || *Value != '=')
+        {
+            continue;
+        }
+
+        ++Value;
+        while (Value < End && isspace((unsigned char)*Value)) ++Value;
+
+        char Quote = Value < End && (*Value == '"' || *Value == '\'') ? *Value++ : '\0';
+        const char *ValueEnd = Value;
+        while (ValueEnd < End && (Quote != '\0' ? *ValueEnd != Quote : !isspace((unsigned char)*ValueEnd) && *ValueEnd != '>'))
+        {
+            ++ValueEnd;
+        }
+
+        char Path[PATH_MAX];
+        if (ResolvePageUrl(Client->PageFile, { Value, (size_t)(ValueEnd - Value) }, Path))
+        {
+            AddClientDependency(Client, Path);
+        }
+
+        At = ValueEnd - 1;
+    }
+}
+
+live_client *FindClientLocked(uint64_t ClientId)
+{
+    for (size_t I = 0; I < ClientRegistry.NumClients; ++I)
+    {
+        if (ClientRegistry.Clients[I].ClientId == ClientId) return &ClientRegistry.Clients[I];
+    }
+
+    return NULL;
+}
+
+void AddClient(uint64_t ClientId, event_loop *Loop)
+{
+    pthread_mutex_lock(&ClientRegistry.Mutex);
 
-    if (stat(ContentFilePath, &Stat) != 0)
+    if (ClientRegistry.NumClients == ClientRegistry.Capacity)
     {
-        // Weder Datei noch Verzeichnis existiert
-        return RequestedFileNotFound;
+        ClientRegistry.Capacity = ClientRegistry.Capacity == 0 ? 16 : ClientRegistry.Capacity * 2;
+        ClientRegistry.Clients  = (live_client *)realloc(ClientRegistry.Clients, ClientRegistry.Capacity * sizeof(live_client));
     }
 
-    if (S_ISREG(Stat.st_mode))
+    live_client *Client = &ClientRegistry.Clients[ClientRegistry.NumClients++];
+    *Client = {};
+    Client->ClientId = ClientId;
+    Client->Loop     = Loop;
+
+    pthread_mutex_unlock(&ClientRegistry.Mutex);
+}
+
+void RemoveClient(uint64_t ClientId)
+{
+    pthread_mutex_lock(&ClientRegistry.Mutex);
+
+    live_client *Client = FindClientLocked(ClientId);
+    if (Client != NULL)
     {
-        // Datei gefunden
-        strncpy(Output, ContentFilePath, PATH_MAX);
-        return RequestedFileFound;
+        free(Client->PageFile);
+        free(Client->Dependencies.Data);
+        *Client = ClientRegistry.Clients[--ClientRegistry.NumClients];
     }
 
-    if (!S_ISDIR(Stat.st_mode))
+    pthread_mutex_unlock(&ClientRegistry.Mutex);
+}
+
+bool ClientDependsOn(const live_client *Client, const char *Path)
+{
+    if (Client->PageFile == NULL || strcmp(Path, "*") == 0 || strcmp(Client->PageFile, Path) == 0)
     {
-        // Könnte ein block device, FIFO, symlink, UNIX socket etc. sein
-        return RequestedFileNotFound;
+        return true;
     }
 
-    // Wenn Verzeichnis ohne '/': 301 zu <dir>/
-    bool EndsWithSlash = ContentFilePath[strlen(ContentFilePath) - 1] == '/';
-    if (!EndsWithSlash)
+    const char *Dependency = Client->Dependencies.Data;
+    for (size_t I = 0; I < Client->NumDependencies; ++I)
     {
-        return RedirectToDirectory;
+        if (strcmp(Dependency, Path) == 0) return true;
+        Dependency += strlen(Dependency) + 1;
     }
 
-    // <dir>/index.html
-    snprintf(Output, PATH_MAX, "%s/%s", ContentFilePath, "index.html");
-
-    bool FileExists = stat(Output, &Stat) == 0 && S_ISREG(Stat.st_mode);
-    
-    return FileExists ? RequestedFileFound : RequestedFileNotFound;
+    return false;
 }
 
-void HandleRequest(request *Request, response *Response)
+// Dateien, von denen niemand (bekanntermaßen) abhängt, gehen an alle. NOTE: free()
+bool *FindKnownPathsLocked(const notification *Notification)
 {
-    switch (ResolveRequestFilePath(Request->Path, Request->ResolvedPath))
+    bool *IsKnown = (bool *)calloc(Notification->NumPaths + 1, sizeof(bool));
+    size_t PathIndex = 0;
+    for (const char *Path = FirstNotificationPath(Notification); Path != NULL; Path = NextNotificationPath(Notification, Path), ++PathIndex)
     {
-        case RequestedFileNotFound:
+        for (size_t I = 0; I < ClientRegistry.NumClients && !IsKnown[PathIndex]; ++I)
         {
-            PrintError("HandleRequest: Dateipfad für '%s' konnte nicht aufgelöst werden", Request->Path);
-
-            Response->Status = HttpStatusNotFound;
-            AddHeader(Response, HttpHeaderContentType, "text/html");
+            const live_client *Client = &ClientRegistry.Clients[I];
+            IsKnown[PathIndex] = Client->PageFile != NULL && ClientDependsOn(Client, Path);
+        }
+    }
 
-            Response->Content     = strdup("Datei wurde nicht gefunden");
-            Response->ContentSize = strlen(Response->Content);
+    return IsKnown;
+}
 
-            return;
-        }
+// Mit --morph: liest für jeden geänderten HTML-Pfad den neuen Inhalt, Seiten, die sich selbst geändert haben,
+// bekommen ihn statt eines Reloads und morphen das DOM. Data bleibt NULL, wo das nicht geht. NOTE: free()
+const size_t MaxMorphHtmlSize = 512 * 1024;  // Deutlich unter MaxWebSocketOutput
 
-        case RedirectToDirectory:
-        {
-            char Location[PATH_MAX];
-            snprintf(Location, PATH_MAX, "%s/", Request->Path);
-            PrintError("HandleRequest: Leite '%s' weiter zu '%s'", Request->Path, Location);
+text_buffer *LoadMorphPages(const notification *Notification)
+{
+    if (!MorphPages || strcmp(Notification->Type, "reload") != 0)
+    {
+        return NULL;
+    }
 
-            Response->Status = HttpStatusMovedPermanently;
-            AddHeader(Response, HttpHeaderContentType, "text/html");
-            AddHeader(Response, HttpHeaderLocation, Location);
+    text_buffer *Pages = (text_buffer *)calloc(Notification->NumPaths + 1, sizeof(text_buffer));
+    size_t PathIndex = 0;
+    for (const char *Path = FirstNotificationPath(Notification); Path != NULL; Path = NextNotificationPath(Notification, Path), ++PathIndex)
+    {
+        // "*" (alles neu laden) ist kein Dateipfad und wird nie zum Morph
+        if (strcmp(Path, "*") == 0 || !IsHtmlPath(Path)) continue;
 
-            Response->Content     = strdup("");
-            Response->ContentSize = strlen(Response->Content);
+        size_t Size = 0;
+        char *Html = ReadEntireContentFile(Path, &Size);
+        if (Html == NULL) continue;
 
-            return;
+        // JSON-String und WebSocket-Text: keine Nullbytes, gültiges UTF-8
+        if (Size > MaxMorphHtmlSize || strlen(Html) != Size || !IsValidUtf8(Html, Size))
+        {
+            free(Html);
+            continue;
         }
 
-        case RequestedFileFound:
-            break;
-
-        default: assert(!"Ungültiges Ergebnis");
+        Pages[PathIndex] = { Html, Size, Size + 1 };
     }
 
-    // Angefragte Datei lesen
+    return Pages;
+}
+
+void FreeMorphPages(text_buffer *Pages, const notification *Notification)
+{
+    for (size_t I = 0; Pages != NULL && I < Notification->NumPaths; ++I) free(Pages[I].Data);
+    free(Pages);
+}
 
-    size_t FileSize = 0;
-    char *FileBuffer = ReadEntireFile(Request->ResolvedPath, &FileSize);
-    defer { free(FileBuffer); FileBuffer = NULL; };
+// Sendet die Pfade, die den Client betreffen. IsKnown aus FindKnownPathsLocked(), NULL = alle Pfade.
+// Betrifft die Änderung nur die Seite selbst und liegt deren HTML in MorphHtml, wird daraus ein "morph".
+// Unter dem Lock, damit die Nachrichten in der Reihenfolge ihrer Sequenznummern in der Outbox landen.
+bool SendNotificationLocked(const live_client *Client, const notification *Notification, uint64_t Seq, const bool *IsKnown, const text_buffer *MorphHtml = NULL)
+{
+    text_buffer Paths = {};
+    size_t NumPaths = 0;
+    const text_buffer *PageHtml = NULL;
 
-    if (FileBuffer == NULL)
+    size_t PathIndex = 0;
+    for (const char *Path = FirstNotificationPath(Notification); Path != NULL; Path = NextNotificationPath(Notification, Path), ++PathIndex)
     {
-        PrintError("HandleRequest: Konnte die angeforderte Datei nicht lesen");
-
-        Response->Status = HttpStatusInternalError;
-        AddHeader(Response, HttpHeaderContentType, "text/html");
+        if (IsKnown != NULL && IsKnown[PathIndex] && !ClientDependsOn(Client, Path)) continue;
 
-        Response->Content     = strdup("Datei konnte nicht gelesen werden");
-        Response->ContentSize = strlen(Response->Content);
+        if (NumPaths++ != 0) TextAppend(&Paths, ",");
+        TextAppendJsonString(&Paths, Path);
 
-        return;
+        bool IsOwnPage = Client->PageFile != NULL && strcmp(Client->PageFile, Path) == 0;
+        if (IsOwnPage && MorphHtml != NULL && MorphHtml[PathIndex].Data != NULL) PageHtml = &MorphHtml[PathIndex];
     }
 
-    const char *ContentType = GetContentTypeForFilename(Request->ResolvedPath);
-
-    bool ShouldInject = strcmp(GetFilenameExtension(Request->ResolvedPath), ".html") == 0;
-    if (!ShouldInject)
+    if (NumPaths == 0)
     {
-        Response->Status = HttpStatusOk;
-        AddHeader(Response, HttpHeaderContentType, ContentType);
-
-        Response->ContentSize = FileSize;
-        Response->Content     = (char *)malloc(FileSize);
-        memcpy(Response->Content, FileBuffer, FileSize);
-
-        return;
+        free(Paths.Data);
+        return false;
     }
 
-    // Skript injizieren
-
-    const char *SentinelPosition = strstr(FileBuffer, Sentinel);
-    if (SentinelPosition == NULL)
+    bool ShouldMorph = NumPaths == 1 && PageHtml != NULL;
+
+    text_buffer Message = {};
+    TextAppend(&Message, "{\"type\":\"");
+    TextAppend(&Message, ShouldMorph ? "morph" : Notification->Type);
+    char SeqField[32];
+    snprintf(SeqField, sizeof(SeqField), "\",\"seq\":%llu,\"paths\":[", (unsigned long long)Seq);
+    TextAppend(&Message, SeqField);
+    TextAppend(&Message, Paths.Data, Paths.Size);
+    TextAppend(&Message, "]");
+    if (ShouldMorph)
     {
-        printf("Konnte %s nicht finden!\n", Sentinel);
+        TextAppend(&Message, ",\"html\":");
+        TextAppendJsonString(&Message, PageHtml->Data);
+    }
 
-        Response->Status = HttpStatusOk;
-        AddHeader(Response, HttpHeaderContentType, ContentType);
+    TextAppend(&Message, "}");
+    free(Paths.Data);
 
-        Response->ContentSize = FileSize;
-        Response->Content     = (char *)malloc(FileSize);
-        memcpy(Response->Content, FileBuffer, FileSize);
+    PostWebSocketMessage(Client->Loop, Client->ClientId, Message.Data, Message.Size);
+    return true;
+}
 
+// Nach Epoche und Sequenznummer verpasste Änderungen nachliefern, davor kommt immer das "hello" mit der
+// aktuellen Epoche. Ist die Epoche eine andere, lädt der Client selbst neu.
+void ReplayChangesLocked(const live_client *Client, str Epoch, uint64_t LastSeenSeq)
+{
+    text_buffer Hello = {};
+    TextAppend(&Hello, "{\"type\":\"hello\",\"epoch\":\"");
+    TextAppend(&Hello, ServerEpoch);
+    char Seq[32];
+    snprintf(Seq, sizeof(Seq), "\",\"seq\":%llu}", (unsigned long long)ClientRegistry.LastSeq);
+    TextAppend(&Hello, Seq);
+    PostWebSocketMessage(Client->Loop, Client->ClientId, Hello.Data, Hello.Size);
+
+    uint64_t LastSeq = ClientRegistry.LastSeq;
+    if (!StrEquals(Epoch, ServerEpoch) || LastSeenSeq >= LastSeq)
+    {
         return;
     }
 
-    Response->Status      = HttpStatusOk;
-    AddHeader(Response, HttpHeaderContentType, ContentType);
-
-    Response->ContentSize = FileSize + sizeof(Script);
-    Response->Content     = (char *)malloc(Response->ContentSize);
-
-    //printf("<head> gefunden!\n");
-    size_t HeadIndex = (SentinelPosition - FileBuffer) + strlen(Sentinel);
-    size_t Pos = 0;
-
-    // Bis zum HeadIndex die originale Datei...
-    memcpy(&Response->Content[Pos], &FileBuffer[0], HeadIndex);
-    Pos += HeadIndex;
+    uint64_t OldestSeq = LastSeq > ChangeLogCapacity ? LastSeq - ChangeLogCapacity + 1 : 1;
+    if (LastSeenSeq + 1 < OldestSeq)
+    {
+        // Zu lange weg, der Ringpuffer hat die Änderungen schon vergessen
+        printf("WebSocket-Client hat %llu Änderung(en) verpasst, lade komplett neu\n", (unsigned long long)(LastSeq - LastSeenSeq));
 
-    // ...dann das Skript...
-    memcpy(&Response->Content[Pos], &Script[0], sizeof(Script));
-    Pos += sizeof(Script);
+        notification ReloadAll = { "reload", {}, 0 };
+        AddNotificationPath(&ReloadAll, "*");
+        SendNotificationLocked(Client, &ReloadAll, LastSeq, NULL);
+        FreeNotification(&ReloadAll);
+        return;
+    }
 
-    // ...dann den Rest der originalen Datei.
-    memcpy(&Response->Content[Pos], &FileBuffer[HeadIndex], FileSize - HeadIndex);
+    printf("WebSocket-Client holt %llu verpasste Änderung(en) nach\n", (unsigned long long)(LastSeq - LastSeenSeq));
+    for (uint64_t Seq = LastSeenSeq + 1; Seq <= LastSeq; ++Seq)
+    {
+        const notification *Notification = &ClientRegistry.ChangeLog[Seq % ChangeLogCapacity];
+        bool *IsKnown = FindKnownPathsLocked(Notification);
+        SendNotificationLocked(Client, Notification, Seq, IsKnown);
+        free(IsKnown);
+    }
 }
 
-void HandleClient()
+// Message ist "<Epoche> <Sequenznummer> <window.location.pathname>", die Epoche "-" bei einer neu
+// geladenen Seite
+void SubscribeClient(uint64_t ClientId, str Message)
 {
-    // Request parsen
-
-    size_t RequestBufferSize = 8192;
-    char  *RequestBuffer     = (char *)malloc(RequestBufferSize);
-    defer { free(RequestBuffer); RequestBuffer = NULL; };
-
-    // -1 Damit am Ende noch mindestens eine '\0' steht.
-    // TODO Loop
-    int RequestBytesRead = read(ClientFd, RequestBuffer, RequestBufferSize - 1);
-    if (RequestBytesRead <= 0)
+    const char *At  = Message.Data;
+    const char *End = Message.Data + Message.Size;
+
+    str Epoch = { At, 0 };
+    while (At < End && *At != ' ') ++At;
+    Epoch.Size = At - Epoch.Data;
+    if (At < End) ++At;
+
+    uint64_t LastSeenSeq = 0;
+    const char *SeqStart = At;
+    while (At < End && isdigit((unsigned char)*At)) LastSeenSeq = LastSeenSeq * 10 + (*At++ - '0');
+    bool IsValid = At > SeqStart && At < End && *At == ' ';
+    if (At < End) ++At;
+
+    str PagePath = { At, (size_t)(End - At) };
+    if (!IsValid)
     {
-        PrintError("HandleClient: read() Fehler");
+        PrintError("SubscribeClient: Ungültige Anmeldung '%.*s'", STR_FMT(Message));
         return;
     }
 
-    if (RequestBytesRead == RequestBufferSize - 1)  // TODO
+    // Außerhalb des Locks vorbereiten, das Lesen der Seite kann dauern
+    live_client Subscription = {};
+    char PageFile[PATH_MAX];
+    if (!ResolvePageUrl("/", PagePath, PageFile) || PageFile[0] != '/')
     {
-        printf("HandleClient: Warnung - Der Request-Buffer ist voll. Es kann sein, dass die Anfrage abgeschnitten ist und deshalb unerwartetes Verhalten auftritt.\n");
+        return;
     }
 
-    // Path aus der Request Line parsen - (siehe W3 HTTP-Message Dokumentation)
+    if (PageFile[strlen(PageFile) - 1] == '/')
+    {
+        strncat(PageFile, "index.html", sizeof(PageFile) - strlen(PageFile) - 1);
+    }
 
-    const char *At = RequestBuffer;
-    while (*At && !isspace(*At)) ++At; // Bis zum ersten Space springen, dann sind ist der Cursor bei dem Request Path
-    while (isspace(*At)) ++At; // Space überspringen - danach kommt der Path
-    while (*At == '/') ++At; // Das erste '/' überspringen
-    const char *RequestPathStart = At;
-    while (*At && !isspace(*At)) ++At; // Bis zum nächsten Space springen, dann ist der Path zu Ende
-    assert(At != RequestBuffer);
+    Subscription.PageFile = strdup(PageFile);
 
-    request Request{};
-    for (size_t I = 0; I < (At - RequestPathStart) && I < PATH_MAX; ++I)
+    size_t HtmlSize;
+    char *Html = ReadEntireContentFile(PageFile, &HtmlSize);
+    if (Html != NULL)
     {
-        Request.Path[I] = RequestPathStart[I];
+        CollectPageDependencies(&Subscription, Html, HtmlSize);
+        free(Html);
     }
 
-    if (RequestLoggingEnabled)
+    printf("WebSocket-Client beobachtet %s (%zu Abhängigkeiten)\n", PageFile, Subscription.NumDependencies);
+
+    pthread_mutex_lock(&ClientRegistry.Mutex);
+
+    live_client *Client = FindClientLocked(ClientId);
+    if (Client != NULL)
     {
-        printf(
-            "\nRequest: Path='%s'; ResolvedPath='%s'\n%s\n",
-            Request.Path,
-            Request.ResolvedPath,
-            RequestBuffer);
+        free(Client->PageFile);
+        free(Client->Dependencies.Data);
+        Client->PageFile        = Subscription.PageFile;
+        Client->Dependencies    = Subscription.Dependencies;
+        Client->NumDependencies = Subscription.NumDependencies;
+        Subscription = {};
+
+        ReplayChangesLocked(Client, Epoch, LastSeenSeq);
     }
 
-    response Response{};
-    defer
-    {
-        for (header *Header = Response.FirstHeader; Header != NULL;)
-        {
-            free(Header->Name);
-            free(Header->Value);
-            header *Next = Header->Next;
-            free(Header);
-            Header = Next;
-        }
-        free(Response.Content);
-    };
+    pthread_mutex_unlock(&ClientRegistry.Mutex);
 
-    HandleRequest(&Request, &Response);
+    free(Subscription.PageFile);
+    free(Subscription.Dependencies.Data);
+}
 
-    assert(Response.Status != NULL);
-    assert(Response.Content != NULL);
+// Thread-sicher. Jeder angemeldete Client bekommt {"type":...,"seq":...,"paths":[...]} mit den Pfaden,
+// die ihn betreffen. Clients, die sich noch nicht angemeldet haben, bekommen die Änderung beim Anmelden
+// aus dem ChangeLog, so kommt bei ihnen nichts doppelt oder in falscher Reihenfolge an.
+void NotifyClients(const notification *Notification)
+{
+    // Außerhalb des Locks, Lesen kann dauern. Nachgeliefert (ReplayChangesLocked()) wird ohne Morphing.
+    text_buffer *MorphHtml = LoadMorphPages(Notification);
 
-    AddHeader(&Response, "Access-Control-Allow-Origin", "*");
-    AddHeader(&Response, "Content-Length", "%d", (int)Response.ContentSize);
+    pthread_mutex_lock(&ClientRegistry.Mutex);
 
-    // Response senden
+    uint64_t Seq = ++ClientRegistry.LastSeq;
+    notification *Logged = &ClientRegistry.ChangeLog[Seq % ChangeLogCapacity];
+    FreeNotification(Logged);
+    *Logged = CopyNotification(Notification);
 
-    char H[4096];
-    int I = 0;
-    I += snprintf(&H[I], sizeof(H) - I, "HTTP/1.1 %s\r\n", Response.Status);
-    for (header *Header = Response.FirstHeader; Header != NULL; Header = Header->Next)
+    size_t NumClients = ClientRegistry.NumClients;
+    size_t NumSent    = 0;
+    if (NumClients > 0)
     {
-        I += snprintf(&H[I], sizeof(H) - I, "%s: %s\r\n", Header->Name, Header->Value);
+        bool *IsKnown = FindKnownPathsLocked(Notification);
+        for (size_t I = 0; I < NumClients; ++I)
+        {
+            const live_client *Client = &ClientRegistry.Clients[I];
+            if (Client->PageFile != NULL && SendNotificationLocked(Client, Notification, Seq, IsKnown, MorphHtml)) ++NumSent;
+        }
+
+        free(IsKnown);
     }
-    I += snprintf(&H[I], sizeof(H) - I, "\r\n");
 
-    WriteEntireBuffer(ClientFd, H, strlen(H));
+    pthread_mutex_unlock(&ClientRegistry.Mutex);
 
-    if (ResponseLoggingEnabled)
-    {
-        printf("\nResponse:\n%s\n", H);
-    }
+    FreeMorphPages(MorphHtml, Notification);
 
-    if (Response.Content != NULL)
+    if (NumClients == 0)
     {
-        WriteEntireBuffer(ClientFd, Response.Content, Response.ContentSize);
+        PrintError("Es ist keine WebSocket-Verbindung offen, Änderung %llu bleibt im ChangeLog", (unsigned long long)Seq);
+        return;
     }
-}
-
-//
-// WebSocket Handlers
-//
-
-void WebSocketOnOpen(ws_cli_conn_t *Conn)
-{
-    char *Client = ws_getaddress(Conn);
-    printf("WebSocket Verbindung hergestellt: %s\n", Client);
-
-    ws_close_client(ClientWebSocketConn);
-    ClientWebSocketConn = Conn;
-}
-
-void WebSocketOnClose(ws_cli_conn_t *Conn)
-{
-    char *Client = ws_getaddress(Conn);
-    printf("WebSocket Verbindung geschlossen: %s\n", Client);
-
-    ws_close_client(ClientWebSocketConn);
-    ClientWebSocketConn = NULL;
-}
 
-void WebSocketOnMessage(ws_cli_conn_t *Conn, const unsigned char *Message, uint64_t Size, int Type)
-{
+    printf("Benachrichtige %zu von %zu WebSocket-Client(s) (Änderung %llu)\n", NumSent, NumClients, (unsigned long long)Seq);
 }
 
 //
@@ -812,7 +5851,17 @@ void PrintUsage()
         "    [--sass|-s]\n"
         "    [--sass-docker]\n"
         "    [--log-requests|-q]\n"
-        "    [--log-responses|-a]\n");
+        "    [--log-responses|-a]\n"
+        "    [--keep-alive-timeout|-k SECONDS]\n"
+        "    [--max-requests-per-connection MAX_REQUESTS]\n"
+        "    [--workers|-w NUM_WORKERS]\n"
+        "    [--pin-cpus]\n"
+        "    [--cache-size|-m MEGABYTES]\n"
+        "    [--poll]\n"
+        "    [--debounce MILLISECONDS]\n"
+        "    [--tsc-oneshot]\n"
+        "    [--inline-script]\n"
+        "    [--morph]\n");
 }
 
 bool ParseArgs(int Argc, char **Argv)
@@ -830,8 +5879,7 @@ bool ParseArgs(int Argc, char **Argv)
                 return false;
             }
 
-            strncpy(ContentDir, NextArg, sizeof(ContentDir));
-            realpath(ContentDir, ContentDir);
+            strncpy(ContentDir, NextArg, sizeof(ContentDir) - 1);
             ++I;
             printf(" * Setze Inhalts-Verzeichnis = %s\n", ContentDir);
         }
@@ -871,8 +5919,7 @@ bool ParseArgs(int Argc, char **Argv)
                 return false;
             }
 
-            WebSocketPort = Port + 1;
-            printf(" * Setze Port = %hu; WebSocket Port = %hu\n", Port, WebSocketPort);
+            printf(" * Setze Port = %hu\n", Port);
         }
         else if (strcmp(Arg, "--sass") == 0)
         {
@@ -894,6 +5941,127 @@ bool ParseArgs(int Argc, char **Argv)
             ResponseLoggingEnabled = true;
             printf(" * Antwort-Logging aktiviert\n");
         }
+        else if (strcmp(Arg, "--keep-alive-timeout") == 0 || strcmp(Arg, "-k") == 0)
+        {
+            if (NextArg == NULL)
+            {
+                PrintUsage();
+                return false;
+            }
+
+            char *EndPtr;
+            KeepAliveTimeout = strtol(NextArg, &EndPtr, 10);
+            ++I;
+            if (EndPtr == NextArg || KeepAliveTimeout < 0)
+            {
+                PrintUsage();
+                return false;
+            }
+
+            printf(" * Setze Keep-Alive Timeout = %ds\n", KeepAliveTimeout);
+        }
+        else if (strcmp(Arg, "--max-requests-per-connection") == 0)
+        {
+            if (NextArg == NULL)
+            {
+                PrintUsage();
+                return false;
+            }
+
+            char *EndPtr;
+            MaxRequestsPerConnection = strtol(NextArg, &EndPtr, 10);
+            ++I;
+            if (EndPtr == NextArg || MaxRequestsPerConnection < 1)
+            {
+                PrintUsage();
+                return false;
+            }
+
+            printf(" * Setze maximale Anzahl Requests pro Verbindung = %d\n", MaxRequestsPerConnection);
+        }
+        else if (strcmp(Arg, "--workers") == 0 || strcmp(Arg, "-w") == 0)
+        {
+            if (NextArg == NULL)
+            {
+                PrintUsage();
+                return false;
+            }
+
+            char *EndPtr;
+            NumWorkers = strtol(NextArg, &EndPtr, 10);
+            ++I;
+            if (EndPtr == NextArg || NumWorkers < 1)
+            {
+                PrintUsage();
+                return false;
+            }
+
+            printf(" * Setze Anzahl Worker-Threads = %d\n", NumWorkers);
+        }
+        else if (strcmp(Arg, "--cache-size") == 0 || strcmp(Arg, "-m") == 0)
+        {
+            if (NextArg == NULL)
+            {
+                PrintUsage();
+                return false;
+            }
+
+            char *EndPtr;
+            long CacheSizeMb = strtol(NextArg, &EndPtr, 10);
+            ++I;
+            if (EndPtr == NextArg || CacheSizeMb < 0)
+            {
+                PrintUsage();
+                return false;
+            }
+
+            CacheBudget = (size_t)CacheSizeMb * 1024 * 1024;
+            printf(" * Setze Cache-Größe = %ld MB%s\n", CacheSizeMb, CacheBudget == 0 ? " (deaktiviert)" : "");
+        }
+        else if (strcmp(Arg, "--poll") == 0)
+        {
+            UsePollingWatcher = true;
+            printf(" * Erkenne Änderungen per Polling statt inotify\n");
+        }
+        else if (strcmp(Arg, "--debounce") == 0)
+        {
+            if (NextArg == NULL)
+            {
+                PrintUsage();
+                return false;
+            }
+
+            char *EndPtr;
+            DebounceMs = strtol(NextArg, &EndPtr, 10);
+            ++I;
+            if (EndPtr == NextArg || DebounceMs < 0)
+            {
+                PrintUsage();
+                return false;
+            }
+
+            printf(" * Setze Ruhezeit vor dem Neuladen = %dms\n", DebounceMs);
+        }
+        else if (strcmp(Arg, "--tsc-oneshot") == 0)
+        {
+            UseTypescriptDaemon = false;
+            printf(" * Kompiliere TypeScript bei jeder Änderung einmal komplett statt mit tsc --watch\n");
+        }
+        else if (strcmp(Arg, "--inline-script") == 0)
+        {
+            InlineClientScript = true;
+            printf(" * Füge das Live-Reload-Skript direkt in jede Seite ein\n");
+        }
+        else if (strcmp(Arg, "--morph") == 0)
+        {
+            MorphPages = true;
+            printf(" * Aktualisiere geänderte Seiten per DOM-Morphing statt sie neu zu laden\n");
+        }
+        else if (strcmp(Arg, "--pin-cpus") == 0)
+        {
+            PinWorkersToCpus = true;
+            printf(" * Binde Worker-Threads an CPUs\n");
+        }
         else
         {
             PrintError("Unbekanntes Argument '%s'", Arg);
@@ -907,8 +6075,12 @@ bool ParseArgs(int Argc, char **Argv)
 
 void Shutdown()
 {
-    close(ServerFd); ServerFd = -1;
-    close(ClientFd); ClientFd = -1;
+    KillJobs();
+
+    for (int I = 0; Workers != NULL && I < NumWorkers; ++I)
+    {
+        close(Workers[I].Loop.ServerFd); Workers[I].Loop.ServerFd = -1;
+    }
 
     if (SassWatcherPid == -1)
     {
@@ -950,74 +6122,81 @@ void Shutdown()
 
 int Run()
 {
-    // HTTP-Socket öffnen
+    // HTTP-Sockets öffnen, einer pro Worker
 
-    ServerFd = socket(AF_INET, SOCK_STREAM, 0);
-    if (ServerFd == -1)
+    Workers = (worker *)calloc(NumWorkers, sizeof(worker));
+    for (int I = 0; I < NumWorkers; ++I)
     {
-        PrintError("Fehler beim Öffnen des Sockets");
-        return 1;
+        Workers[I].Index         = I;
+        Workers[I].Loop.ServerFd = -1;
+        Workers[I].Loop.EpollFd  = -1;
+        Workers[I].Loop.WakeFd   = -1;
+        pthread_mutex_init(&Workers[I].Loop.OutboxMutex, NULL);
     }
 
-    int SoReuseAddr = 1;
-    if (setsockopt(ServerFd, SOL_SOCKET, SO_REUSEADDR, &SoReuseAddr, sizeof(int)) < 0)
+    defer
     {
-        PrintError("Fehler beim Konfigurieren des Sockets");
-        return 1;
-    }
-
-    sockaddr_in ServerAddress{};
-    ServerAddress.sin_family      = AF_INET;
-    ServerAddress.sin_addr.s_addr = htonl(INADDR_ANY);
-    ServerAddress.sin_port        = htons(Port);
+        for (int I = 0; I < NumWorkers; ++I)
+        {
+            if (Workers[I].Loop.ServerFd != -1) close(Workers[I].Loop.ServerFd);
+            if (Workers[I].Loop.EpollFd  != -1) close(Workers[I].Loop.EpollFd);
+            if (Workers[I].Loop.WakeFd   != -1) close(Workers[I].Loop.WakeFd);
+        }
 
-    int BindResult = bind(ServerFd, (sockaddr *)&ServerAddress, sizeof(ServerAddress));
-    if (BindResult != 0)
-    {
-        PrintError("Fehler beim Binden des Sockets");
-        return 1;
-    }
+        free(Workers); Workers = NULL;
+    };
 
-    int ListenResult = listen(ServerFd, SOMAXCONN);
-    if (ListenResult != 0)
+    for (int I = 0; I < NumWorkers; ++I)
     {
-        PrintError("Fehler beim Binden des Sockets");
-        return 1;
-    }
+        Workers[I].Loop.ServerFd = OpenServerSocket();
+        if (Workers[I].Loop.ServerFd == -1)
+        {
+            return 1;
+        }
 
-    printf("LiveGate läuft auf Port=%hu, WebSocketPort=%hu\n", Port, WebSocketPort);
+        Workers[I].Loop.EpollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (Workers[I].Loop.EpollFd == -1)
+        {
+            PrintError("Fehler beim Erstellen der epoll-Instanz");
+            return 1;
+        }
 
-    // WebSocket öffnen
+        Workers[I].Loop.WakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (Workers[I].Loop.WakeFd == -1)
+        {
+            PrintError("Fehler beim Erstellen des eventfd");
+            return 1;
+        }
+    }
 
-    struct ws_events WebSocketEvents;
-    WebSocketEvents.onopen    = &WebSocketOnOpen;
-    WebSocketEvents.onclose   = &WebSocketOnClose;
-    WebSocketEvents.onmessage = &WebSocketOnMessage;
-    int RunWebSocketOnOwnThread = 1;
-    ws_socket(&WebSocketEvents, WebSocketPort, RunWebSocketOnOwnThread, 1000);
+    printf("LiveGate läuft auf Port=%hu, Worker=%d\n", Port, NumWorkers);
 
     StartSassWatcher();
+    if (UseTypescriptDaemon) StartTypescriptDaemon();
 
-    // Auf Verbindungen warten
+    // Worker starten - Worker 0 läuft auf dem Haupt-Thread
 
-    for (int ConnectionCounter = 0;; ++ConnectionCounter)
+    for (int I = 1; I < NumWorkers; ++I)
     {
-        //printf("Warte auf Client\n");
-        struct sockaddr_in ClientAddress;
-        socklen_t Len = sizeof(ClientAddress);
-        ClientFd = accept(ServerFd, (sockaddr *)&ClientAddress, &Len);
-        if (ClientFd != -1)
-        {
-            //printf("[================CLIENT VERBUNDEN================] (%d)\n", ConnectionCounter);
-            HandleClient();
-            close(ClientFd); ClientFd = -1;
-        }
-        else
+        Workers[I].ThreadStarted = pthread_create(&Workers[I].ThreadId, NULL, WorkerThreadCallback, &Workers[I]) == 0;
+        if (!Workers[I].ThreadStarted)
         {
-            PrintError("Fehler beim Annehmen des Clients, weiter geht's");
+            // Socket schließen, damit der Kernel keine Verbindungen mehr an diesen Worker verteilt
+            PrintError("Konnte Worker-Thread %d nicht starten, mache ohne ihn weiter", I);
+            close(Workers[I].Loop.ServerFd); Workers[I].Loop.ServerFd = -1;
         }
     }
 
+    WorkerThreadCallback(&Workers[0]);
+
+    for (int I = 1; I < NumWorkers; ++I)
+    {
+        if (!Workers[I].ThreadStarted) continue;
+
+        void *JoinStatus;
+        pthread_join(Workers[I].ThreadId, &JoinStatus);
+    }
+
     Shutdown();
 
     return 0;
@@ -1035,22 +6214,36 @@ int main(int Argc, char **Argv)
 {
     signal(SIGINT, HandleSignal);
     signal(SIGKILL, HandleSignal);
+    signal(SIGTERM, HandleSignal);  // Sonst bleiben Build-Jobs und Daemons in ihren Prozessgruppen zurück
+    signal(SIGPIPE, SIG_IGN);  // Clients dürfen die Verbindung jederzeit schließen
 
     setvbuf(stdout, NULL, _IONBF, 0);
 
+    InitCache();
+    InitServerEpoch();
+    if (!InitJobRunner())
+    {
+        return 1;
+    }
+
     int Result = 1;
 
-    if (ParseArgs(Argc, Argv))
+    if (ParseArgs(Argc, Argv) && OpenContentDir())
     {
+        InitClientScript();
+
         bool IsRunning = true;
         pthread_t WatcherThreadId;
         pthread_create(&WatcherThreadId, NULL, FileWatcherThreadCallback, &IsRunning);
+        pthread_t JobRunnerThreadId;
+        pthread_create(&JobRunnerThreadId, NULL, JobRunnerThreadCallback, &IsRunning);
 
         Result = Run();
 
         IsRunning = false;
         void *JoinStatus;
         pthread_join(WatcherThreadId, &JoinStatus);
+        pthread_join(JobRunnerThreadId, &JoinStatus);
 
         Shutdown();
     }
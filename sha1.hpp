@@ -0,0 +1,111 @@
+// SHA-1 nach RFC 3174 und Base64 nach RFC 4648, beides nur für Sec-WebSocket-Accept (RFC 6455).
+// SHA-1 ist hier keine Sicherheitsfunktion, der Handshake schreibt es nur vor.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+const size_t Sha1DigestSize = 20;
+
+inline uint32_t Sha1RotateLeft(uint32_t Value, int Bits)
+{
+    return (Value << Bits) | (Value >> (32 - Bits));
+}
+
+inline void Sha1ProcessBlock(uint32_t *State, const unsigned char *Block)
+{
+    uint32_t Words[80];
+    for (int I = 0; I < 16; ++I)
+    {
+        Words[I] = ((uint32_t)Block[I * 4] << 24) | ((uint32_t)Block[I * 4 + 1] << 16) |
+                   ((uint32_t)Block[I * 4 + 2] << 8) | (uint32_t)Block[I * 4 + 3];
+    }
+
+    for (int I = 16; I < 80; ++I)
+    {
+        Words[I] = Sha1RotateLeft(Words[I - 3] ^ Words[I - 8] ^ Words[I - 14] ^ Words[I - 16], 1);
+    }
+
+    uint32_t A = State[0], B = State[1], C = State[2], D = State[3], E = State[4];
+    for (int I = 0; I < 80; ++I)
+    {
+        uint32_t F, K;
+        if (I < 20)      { F = (B & C) | (~B & D);          K = 0x5A827999; }
+        else if (I < 40) { F = B ^ C ^ D;                   K = 0x6ED9EBA1; }
+        else if (I < 60) { F = (B & C) | (B & D) | (C & D); K = 0x8F1BBCDC; }
+        else             { F = B ^ C ^ D;                   K = 0xCA62C1D6; }
+
+        uint32_t Temp = Sha1RotateLeft(A, 5) + F + E + K + Words[I];
+        E = D;
+        D = C;
+        C = Sha1RotateLeft(B, 30);
+        B = A;
+        A = Temp;
+    }
+
+    State[0] += A;
+    State[1] += B;
+    State[2] += C;
+    State[3] += D;
+    State[4] += E;
+}
+
+inline void HashSha1(const void *Data, size_t Size, unsigned char *Digest)
+{
+    uint32_t State[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    const unsigned char *At = (const unsigned char *)Data;
+
+    size_t Remaining = Size;
+    for (; Remaining >= 64; Remaining -= 64, At += 64)
+    {
+        Sha1ProcessBlock(State, At);
+    }
+
+    // Padding: 0x80, Nullen, Länge in Bits als 64-Bit Big Endian
+    unsigned char Tail[128] = {};
+    memcpy(Tail, At, Remaining);
+    Tail[Remaining] = 0x80;
+    size_t TailSize = Remaining < 56 ? 64 : 128;
+    uint64_t BitCount = (uint64_t)Size * 8;
+    for (int I = 0; I < 8; ++I)
+    {
+        Tail[TailSize - 1 - I] = (unsigned char)(BitCount >> (I * 8));
+    }
+
+    Sha1ProcessBlock(State, Tail);
+    if (TailSize == 128)
+    {
+        Sha1ProcessBlock(State, Tail + 64);
+    }
+
+    for (int I = 0; I < 5; ++I)
+    {
+        Digest[I * 4]     = (unsigned char)(State[I] >> 24);
+        Digest[I * 4 + 1] = (unsigned char)(State[I] >> 16);
+        Digest[I * 4 + 2] = (unsigned char)(State[I] >> 8);
+        Digest[I * 4 + 3] = (unsigned char)State[I];
+    }
+}
+
+// Output braucht Platz für 4 * ((Size + 2) / 3) + 1 Zeichen
+inline size_t EncodeBase64(const unsigned char *Data, size_t Size, char *Output)
+{
+    static const char Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t OutputSize = 0;
+    for (size_t I = 0; I < Size; I += 3)
+    {
+        uint32_t Group = (uint32_t)Data[I] << 16;
+        if (I + 1 < Size) Group |= (uint32_t)Data[I + 1] << 8;
+        if (I + 2 < Size) Group |= (uint32_t)Data[I + 2];
+
+        Output[OutputSize++] = Alphabet[(Group >> 18) & 63];
+        Output[OutputSize++] = Alphabet[(Group >> 12) & 63];
+        Output[OutputSize++] = I + 1 < Size ? Alphabet[(Group >> 6) & 63] : '=';
+        Output[OutputSize++] = I + 2 < Size ? Alphabet[Group & 63] : '=';
+    }
+
+    Output[OutputSize] = 0;
+    return OutputSize;
+}